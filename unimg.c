@@ -12,6 +12,9 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #define _CRT_SECURE_NO_WARNINGS
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+  #define _GNU_SOURCE   /* copy_file_range */
+#endif
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -24,13 +27,36 @@
 #ifdef _WIN32
   #include <windows.h>
   #include <direct.h>
+  #include <io.h>
+  #include <sys/stat.h>
+  #include <sys/utime.h>
   #define path_sep '\\'
   #define fseek64 _fseeki64
   #define ftell64 _ftelli64
   typedef unsigned long long u64;
 #else
   #include <sys/stat.h>
+  #include <sys/mman.h>
+  #include <sys/resource.h>
+  #include <sys/file.h>
+  #include <fcntl.h>
+  #include <dirent.h>
+  #include <utime.h>
   #include <unistd.h>
+  #include <pthread.h>
+  #ifdef __linux__
+    #include <sys/sendfile.h>
+    #include <sys/ioctl.h>
+    #include <linux/fs.h>   /* FICLONERANGE */
+    #include <sys/syscall.h>
+    #include <sys/uio.h>
+    #if defined(__has_include)
+      #if __has_include(<linux/io_uring.h>)
+        #include <linux/io_uring.h>
+        #define UNIMG_URING 1
+      #endif
+    #endif
+  #endif
   #define path_sep '/'
   #define fseek64 fseeko
   #define ftell64 ftello
@@ -38,6 +64,25 @@
 #endif
 
 #include <zlib.h>
+#ifdef UNIMG_HAVE_LIBDEFLATE
+  #include <libdeflate.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+  #define UNIMG_X86 1
+  #include <immintrin.h>
+  #ifdef _MSC_VER
+    #include <intrin.h>
+  #endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+  #define TARGET_SSE2 __attribute__((target("sse2")))
+  #define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+  #define TARGET_SSE2
+  #define TARGET_AVX2
+#endif
 
 typedef struct {
     uint32_t lvz_off;
@@ -48,12 +93,19 @@ typedef struct {
     uint32_t global_count;
     uint32_t continuation;
     uint32_t reserved;
+    uint8_t raw[32];    /* the header as found, written out verbatim */
 } WrldHeader;
 
+typedef struct Alloc Alloc;
+
 typedef struct {
     WrldHeader* items;
     size_t count;
     size_t cap;
+    Alloc* al;          /* where items lives */
+    size_t max;         /* spill to a temporary file past this many (0 = never) */
+    size_t spilled;     /* headers already in spill, which come before items */
+    FILE* spill;
 } HeaderList;
 
 static void die(const char* fmt, ...) {
@@ -81,6 +133,304 @@ static uint32_t read_u32le(const uint8_t* b, size_t off) {
          | ((uint32_t)b[off+2] << 16) | ((uint32_t)b[off+3] << 24);
 }
 
+static u64 read_u64le(const uint8_t* b, size_t off) {
+    return (u64)read_u32le(b, off) | ((u64)read_u32le(b, off + 4) << 32);
+}
+
+static void put_u32le(uint8_t* b, size_t off, uint32_t v) {
+    b[off] = (uint8_t)v; b[off+1] = (uint8_t)(v >> 8);
+    b[off+2] = (uint8_t)(v >> 16); b[off+3] = (uint8_t)(v >> 24);
+}
+
+static void put_u64le(uint8_t* b, size_t off, u64 v) {
+    put_u32le(b, off, (uint32_t)v);
+    put_u32le(b, off + 4, (uint32_t)(v >> 32));
+}
+
+static int ctz32(uint32_t v) {
+#ifdef _MSC_VER
+    unsigned long i; _BitScanForward(&i, v); return (int)i;
+#else
+    return __builtin_ctz(v);
+#endif
+}
+
+/* monotonic seconds, for benchmarks */
+static double now_sec(void) {
+#ifdef _WIN32
+    LARGE_INTEGER f, c;
+    QueryPerformanceFrequency(&f); QueryPerformanceCounter(&c);
+    return (double)c.QuadPart / (double)f.QuadPart;
+#else
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+/* minimal portable threads */
+typedef void* (*thread_fn)(void*);
+#ifdef _WIN32
+typedef HANDLE thread_t;
+typedef struct { thread_fn fn; void* arg; } ThreadTramp;
+static DWORD WINAPI thread_tramp(LPVOID p) {
+    ThreadTramp t = *(ThreadTramp*)p;
+    free(p);
+    t.fn(t.arg);
+    return 0;
+}
+#else
+typedef pthread_t thread_t;
+#endif
+
+/* 0 on success; on failure the caller runs fn inline */
+static int thread_start(thread_t* t, thread_fn fn, void* arg) {
+#ifdef _WIN32
+    ThreadTramp* tr = (ThreadTramp*)xmalloc(sizeof(ThreadTramp));
+    tr->fn = fn; tr->arg = arg;
+    *t = CreateThread(NULL, 0, thread_tramp, tr, 0, NULL);
+    if (!*t) { free(tr); return -1; }
+    return 0;
+#else
+    return pthread_create(t, NULL, fn, arg) == 0 ? 0 : -1;
+#endif
+}
+
+static void thread_join(thread_t t) {
+#ifdef _WIN32
+    WaitForSingleObject(t, INFINITE);
+    CloseHandle(t);
+#else
+    pthread_join(t, NULL);
+#endif
+}
+
+#ifdef _WIN32
+typedef CRITICAL_SECTION mutex_t;
+static void mutex_init(mutex_t* m)    { InitializeCriticalSection(m); }
+static void mutex_lock(mutex_t* m)    { EnterCriticalSection(m); }
+static void mutex_unlock(mutex_t* m)  { LeaveCriticalSection(m); }
+static void mutex_destroy(mutex_t* m) { DeleteCriticalSection(m); }
+#else
+typedef pthread_mutex_t mutex_t;
+static void mutex_init(mutex_t* m)    { pthread_mutex_init(m, NULL); }
+static void mutex_lock(mutex_t* m)    { pthread_mutex_lock(m); }
+static void mutex_unlock(mutex_t* m)  { pthread_mutex_unlock(m); }
+static void mutex_destroy(mutex_t* m) { pthread_mutex_destroy(m); }
+#endif
+
+#ifdef _WIN32
+typedef CONDITION_VARIABLE cond_t;
+static void cond_init(cond_t* c)               { InitializeConditionVariable(c); }
+static void cond_wait(cond_t* c, mutex_t* m)   { SleepConditionVariableCS(c, m, INFINITE); }
+static void cond_signal(cond_t* c)             { WakeConditionVariable(c); }
+static void cond_destroy(cond_t* c)            { (void)c; }
+#else
+typedef pthread_cond_t cond_t;
+static void cond_init(cond_t* c)               { pthread_cond_init(c, NULL); }
+static void cond_wait(cond_t* c, mutex_t* m)   { pthread_cond_wait(c, m); }
+static void cond_signal(cond_t* c)             { pthread_cond_signal(c); }
+static void cond_destroy(cond_t* c)            { pthread_cond_destroy(c); }
+#endif
+
+static int cpu_count(void) {
+#ifdef _WIN32
+    SYSTEM_INFO si; GetSystemInfo(&si);
+    return si.dwNumberOfProcessors > 0 ? (int)si.dwNumberOfProcessors : 1;
+#else
+    long c = sysconf(_SC_NPROCESSORS_ONLN);
+    return c > 0 ? (int)c : 1;
+#endif
+}
+
+/* ---- allocators ----
+   Per-file metadata (header records, plan tables, worker and scan
+   partition tables, io_uring slots, zidx points and windows, staged log
+   text) is allocated through an Alloc. The system allocator is plain
+   malloc/realloc/free. The arena bumps through large blocks, ignores
+   release and is reset after each LVZ; a reset folds its blocks into one,
+   so later files in a batch are served without touching malloc at all.
+   Workers stage log text concurrently, so the arena takes a lock.
+   Left on malloc: large data buffers (see big_alloc), which would pin
+   arena blocks at their peak; the process-wide copy buffer pool and
+   command-line lists; per-thread scratch (decoder state, scan parts,
+   read-ahead helpers, thread start blocks), which grows side by side or
+   is freed on another thread; and the fixed stream I/O buffers. */
+
+struct Alloc {
+    void* (*alloc)(Alloc* a, size_t n);
+    void* (*grow)(Alloc* a, void* p, size_t old, size_t n);
+    void (*release)(Alloc* a, void* p);
+};
+
+static void* sys_alloc_fn(Alloc* a, size_t n) { (void)a; return xmalloc(n); }
+static void* sys_grow_fn(Alloc* a, void* p, size_t old, size_t n) { (void)a; (void)old; return xrealloc(p, n); }
+static void sys_release_fn(Alloc* a, void* p) { (void)a; free(p); }
+
+static Alloc sys_alloc = { sys_alloc_fn, sys_grow_fn, sys_release_fn };
+
+#define ARENA_BLOCK (1u << 20)
+#define ARENA_ALIGN 16u
+
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;    /* older blocks */
+    size_t cap, used;
+} ArenaBlock;
+
+typedef struct {
+    Alloc base;                 /* first, so an Arena* is an Alloc* */
+    mutex_t mu;
+    ArenaBlock* head;
+    void* last;                 /* most recent allocation, which can grow in place */
+    size_t used, peak;          /* bytes handed out since the last reset */
+    u64 allocs, grows, in_place, blocks;   /* since the last reset */
+} Arena;
+
+#define ARENA_HDR ((sizeof(ArenaBlock) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+static uint8_t* arena_data(ArenaBlock* b) { return (uint8_t*)b + ARENA_HDR; }
+
+static void arena_new_block(Arena* ar, size_t need) {
+    size_t cap = need > ARENA_BLOCK ? need : ARENA_BLOCK;
+    ArenaBlock* b = (ArenaBlock*)xmalloc(ARENA_HDR + cap);
+    b->next = ar->head; b->cap = cap; b->used = 0;
+    ar->head = b;
+    ++ar->blocks;
+}
+
+/* caller holds mu */
+static void* arena_bump(Arena* ar, size_t n) {
+    n = (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (!ar->head || ar->head->cap - ar->head->used < n) arena_new_block(ar, n);
+    void* p = arena_data(ar->head) + ar->head->used;
+    ar->head->used += n;
+    ar->used += n;
+    if (ar->used > ar->peak) ar->peak = ar->used;
+    ar->last = p;
+    return p;
+}
+
+static void* arena_alloc_fn(Alloc* a, size_t n) {
+    Arena* ar = (Arena*)a;
+    mutex_lock(&ar->mu);
+    ++ar->allocs;
+    void* p = arena_bump(ar, n ? n : 1);
+    mutex_unlock(&ar->mu);
+    return p;
+}
+
+/* the latest allocation grows where it is; anything else moves and leaves
+   its old bytes until the reset */
+static void* arena_grow_fn(Alloc* a, void* p, size_t old, size_t n) {
+    if (!p) return arena_alloc_fn(a, n);
+    if (n <= old) return p;
+    Arena* ar = (Arena*)a;
+    mutex_lock(&ar->mu);
+    ++ar->grows;
+    size_t o = (old + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    size_t m = (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    void* q;
+    if (p == ar->last && (uint8_t*)p + o == arena_data(ar->head) + ar->head->used &&
+        ar->head->cap - ar->head->used >= m - o) {
+        ar->head->used += m - o;
+        ar->used += m - o;
+        if (ar->used > ar->peak) ar->peak = ar->used;
+        ++ar->in_place;
+        q = p;
+    } else {
+        q = arena_bump(ar, m);
+        memcpy(q, p, old);
+    }
+    mutex_unlock(&ar->mu);
+    return q;
+}
+
+static void arena_release_fn(Alloc* a, void* p) { (void)a; (void)p; }
+
+static void arena_init(Arena* ar) {
+    memset(ar, 0, sizeof(*ar));
+    ar->base.alloc = arena_alloc_fn;
+    ar->base.grow = arena_grow_fn;
+    ar->base.release = arena_release_fn;
+    mutex_init(&ar->mu);
+}
+
+/* forget every allocation; several blocks are replaced by one that holds
+   them all, so the next file of the same size needs no new block */
+static void arena_reset(Arena* ar) {
+    size_t total = 0, n = 0;
+    for (ArenaBlock* b = ar->head; b; b = b->next) { total += b->cap; ++n; }
+    if (n > 1) {
+        while (ar->head) { ArenaBlock* b = ar->head; ar->head = b->next; free(b); }
+        arena_new_block(ar, total);
+    }
+    if (ar->head) ar->head->used = 0;
+    ar->last = NULL;
+    ar->used = ar->peak = 0;
+    ar->allocs = ar->grows = ar->in_place = ar->blocks = 0;
+}
+
+static void arena_free(Arena* ar) {
+    while (ar->head) { ArenaBlock* b = ar->head; ar->head = b->next; free(b); }
+    mutex_destroy(&ar->mu);
+}
+
+/* growable text buffer, for log lines written off the main thread */
+typedef struct {
+    char* p;
+    size_t len, cap;
+    Alloc* al;          /* NULL = system */
+} StrBuf;
+
+static void sb_printf(StrBuf* b, const char* fmt, ...) {
+    va_list ap, ap2;
+    va_start(ap, fmt);
+    va_copy(ap2, ap);
+    int n = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    if (n > 0) {
+        if (b->len + (size_t)n + 1 > b->cap) {
+            size_t cap = (b->len + (size_t)n + 1) * 2;
+            b->p = b->al ? (char*)b->al->grow(b->al, b->p, b->cap, cap) : (char*)xrealloc(b->p, cap);
+            b->cap = cap;
+        }
+        vsnprintf(b->p + b->len, (size_t)n + 1, fmt, ap2);
+        b->len += (size_t)n;
+    }
+    va_end(ap2);
+}
+
+static void sb_flush(StrBuf* b, FILE* f) {
+    if (b->len) fwrite(b->p, 1, b->len, f);
+    b->len = 0;
+}
+
+static void sb_free(StrBuf* b) {
+    if (b->al) b->al->release(b->al, b->p);
+    else free(b->p);
+    b->p = NULL; b->len = b->cap = 0;
+}
+
+/* positional read of up to n bytes; never moves f's file position */
+static size_t pread_full(FILE* f, void* buf, size_t n, u64 off) {
+#ifdef _WIN32
+    HANDLE h = (HANDLE)_get_osfhandle(_fileno(f));
+    OVERLAPPED ov; memset(&ov, 0, sizeof(ov));
+    ov.Offset = (DWORD)off; ov.OffsetHigh = (DWORD)(off >> 32);
+    DWORD got = 0;
+    if (!ReadFile(h, buf, (DWORD)n, &got, &ov)) return 0;
+    return got;
+#else
+    size_t done = 0;
+    while (done < n) {
+        ssize_t r = pread(fileno(f), (char*)buf + done, n - done, (off_t)(off + done));
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        done += (size_t)r;
+    }
+    return done;
+#endif
+}
+
 static int file_exists(const char* path) {
 #ifdef _WIN32
     DWORD a = GetFileAttributesA(path);
@@ -90,6 +440,360 @@ static int file_exists(const char* path) {
 #endif
 }
 
+/* size and modification time, for telling whether a sidecar file is stale */
+static int file_stat(const char* path, u64* size, u64* mtime) {
+#ifdef _WIN32
+    struct __stat64 st;
+    if (_stat64(path, &st) != 0) return -1;
+#else
+    struct stat st;
+    if (stat(path, &st) != 0) return -1;
+#endif
+    *size = (u64)st.st_size;
+    *mtime = (u64)st.st_mtime;
+    return 0;
+}
+
+/* whole file, read-only: mapped on POSIX, read into memory elsewhere.
+   NULL for missing or empty files. */
+static const uint8_t* map_file_ro(const char* path, size_t* len) {
+#ifdef _WIN32
+    FILE* f = fopen(path, "rb");
+    if (!f) return NULL;
+    _fseeki64(f, 0, SEEK_END);
+    long long n = _ftelli64(f);
+    _fseeki64(f, 0, SEEK_SET);
+    uint8_t* p = n > 0 ? (uint8_t*)xmalloc((size_t)n) : NULL;
+    if (p && fread(p, 1, (size_t)n, f) != (size_t)n) { free(p); p = NULL; }
+    fclose(f);
+    *len = p ? (size_t)n : 0;
+    return p;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    void* p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return NULL;
+    *len = (size_t)st.st_size;
+    return (const uint8_t*)p;
+#endif
+}
+
+static void unmap_file(const uint8_t* p, size_t len) {
+#ifdef _WIN32
+    (void)len;
+    free((void*)p);
+#else
+    if (p) munmap((void*)p, len);
+#endif
+}
+
+/* ---- large buffers ----
+   Buffers of a huge page or more (LVZ segments, inflate output, copy
+   buffer slabs, the io_uring pool) are scanned or copied end to end, so on
+   Linux they get their own 2 MiB-aligned anonymous mapping with
+   MADV_HUGEPAGE, or MAP_HUGETLB with --huge hugetlb when huge pages are
+   reserved. Anything that fails falls back a step: hugetlb to THP, a
+   mapping to malloc. Live mappings are kept in a small table so big_free
+   can tell them from heap pointers. */
+
+#define HUGE_PAGE (2u << 20)
+
+typedef enum { HUGE_OFF = 0, HUGE_THP, HUGE_TLB } HugeMode;
+
+typedef struct {
+    void* p;
+    size_t len;
+} HugeMap;
+
+static struct {
+    mutex_t mu;
+    HugeMode mode;
+    HugeMap* map;
+    size_t n, cap;
+    size_t live;              /* bytes in live mappings */
+    u64 tlb_refused;          /* MAP_HUGETLB failures that fell back to THP */
+} huge;
+
+static void huge_init(HugeMode mode) {
+    mutex_init(&huge.mu);
+#ifdef __linux__
+    huge.mode = mode;
+#else
+    huge.mode = HUGE_OFF; (void)mode;
+#endif
+}
+
+static const char* huge_mode_name(HugeMode m) {
+    return m == HUGE_TLB ? "hugetlb" : m == HUGE_THP ? "thp" : "off";
+}
+
+#ifdef __linux__
+static void* huge_map(size_t len) {
+    void* p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (huge.mode == HUGE_TLB) {
+        p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) return p;
+        mutex_lock(&huge.mu); ++huge.tlb_refused; mutex_unlock(&huge.mu);
+    }
+#endif
+    /* one huge page extra, then trim both ends to a 2 MiB boundary */
+    uint8_t* q = (uint8_t*)mmap(NULL, len + HUGE_PAGE, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (q == (uint8_t*)MAP_FAILED) return NULL;
+    size_t head = (HUGE_PAGE - ((uintptr_t)q & (HUGE_PAGE - 1))) & (HUGE_PAGE - 1);
+    if (head) munmap(q, head);
+    munmap(q + head + len, HUGE_PAGE - head);
+#ifdef MADV_HUGEPAGE
+    madvise(q + head, len, MADV_HUGEPAGE);
+#endif
+    return q + head;
+}
+#endif
+
+/* malloc for anything below a huge page or when huge pages are off */
+static void* big_alloc(size_t n) {
+#ifdef __linux__
+    if (huge.mode != HUGE_OFF && n >= HUGE_PAGE) {
+        size_t len = (n + HUGE_PAGE - 1) & ~(size_t)(HUGE_PAGE - 1);
+        void* p = huge_map(len);
+        if (p) {
+            mutex_lock(&huge.mu);
+            if (huge.n == huge.cap) {
+                huge.cap = huge.cap ? huge.cap * 2 : 16;
+                huge.map = (HugeMap*)xrealloc(huge.map, huge.cap * sizeof(HugeMap));
+            }
+            huge.map[huge.n].p = p; huge.map[huge.n].len = len;
+            ++huge.n;
+            huge.live += len;
+            mutex_unlock(&huge.mu);
+            return p;
+        }
+        /* still page-aligned, as copy buffer slabs must be */
+        if (posix_memalign(&p, 4096, n) == 0) return p;
+    }
+#endif
+    return xmalloc(n);
+}
+
+/* length of p's mapping, 0 for a heap pointer */
+static size_t big_size(void* p) {
+    size_t len = 0;
+    if (!p) return 0;
+    mutex_lock(&huge.mu);
+    for (size_t k = 0; k < huge.n; ++k) if (huge.map[k].p == p) { len = huge.map[k].len; break; }
+    mutex_unlock(&huge.mu);
+    return len;
+}
+
+static void big_free(void* p) {
+#ifdef __linux__
+    if (big_size(p)) {
+        size_t len = 0;
+        mutex_lock(&huge.mu);
+        for (size_t k = 0; k < huge.n; ++k) {
+            if (huge.map[k].p != p) continue;
+            len = huge.map[k].len;
+            huge.map[k] = huge.map[--huge.n];
+            break;
+        }
+        huge.live -= len;
+        mutex_unlock(&huge.mu);
+        munmap(p, len);
+        return;
+    }
+#endif
+    free(p);
+}
+
+/* realloc for big_alloc buffers; used is how much of p to keep. The
+   rounding slack of a mapping is taken before anything moves. */
+static void* big_grow(void* p, size_t used, size_t n) {
+    size_t len = big_size(p);
+    if (len && n <= len) return p;
+    if (!len && n < HUGE_PAGE) return xrealloc(p, n);
+    void* q = big_alloc(n);
+    if (p) memcpy(q, p, used);
+    big_free(p);
+    return q;
+}
+
+/* huge pages actually backing the madvised and hugetlb mappings, from
+   /proc/self/smaps; -1 where that is not available */
+static int huge_pages(u64* thp, u64* tlb) {
+    *thp = *tlb = 0;
+#ifdef __linux__
+    FILE* f = fopen("/proc/self/smaps", "r");
+    if (!f) return -1;
+    char line[512];
+    unsigned long long anon = 0, hugetlb = 0, kb;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "AnonHugePages: %llu kB", &kb) == 1) anon = kb;
+        else if (sscanf(line, "Private_Hugetlb: %llu kB", &kb) == 1 ||
+                 sscanf(line, "Shared_Hugetlb: %llu kB", &kb) == 1) hugetlb += kb;
+        else if (strncmp(line, "VmFlags:", 8) == 0) {
+            /* the last line of each mapping */
+            if (strstr(line, " hg")) *thp += anon / (HUGE_PAGE >> 10);
+            if (strstr(line, " ht")) *tlb += hugetlb / (HUGE_PAGE >> 10);
+            anon = hugetlb = 0;
+        }
+    }
+    fclose(f);
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+static void huge_report(FILE* log, const char* what) {
+    if (huge.mode == HUGE_OFF) return;
+    u64 thp, tlb;
+    mutex_lock(&huge.mu);
+    size_t live = huge.live;
+    u64 refused = huge.tlb_refused;
+    mutex_unlock(&huge.mu);
+    fprintf(log, "[mem] huge pages %s: %zu MiB of buffers mapped 2 MiB-aligned (%s)", what, live >> 20,
+            huge_mode_name(huge.mode));
+    if (huge_pages(&thp, &tlb) == 0)
+        fprintf(log, "; %llu huge pages (THP %llu, hugetlb %llu)", (unsigned long long)(thp + tlb),
+                (unsigned long long)thp, (unsigned long long)tlb);
+    else
+        fprintf(log, "; huge page count not available");
+    if (refused) fprintf(log, "; MAP_HUGETLB refused %llu times", (unsigned long long)refused);
+    fprintf(log, "\n");
+}
+
+/* bytes that are either heap-owned or a read-only file mapping */
+typedef struct {
+    const uint8_t* data;
+    size_t len;
+    int mapped;
+} Blob;
+
+static void blob_release(Blob* b) {
+    if (b->mapped) unmap_file(b->data, b->len);
+    else big_free((void*)b->data);
+    b->data = NULL; b->len = 0; b->mapped = 0;
+}
+
+/* a whole file as a Blob, see map_file_ro */
+static int blob_map(const char* path, Blob* out) {
+    size_t len = 0;
+    const uint8_t* p = map_file_ro(path, &len);
+    if (!p) return -1;
+    out->data = p; out->len = len;
+#ifdef _WIN32
+    out->mapped = 0;
+#else
+    out->mapped = 1;
+#endif
+    return 0;
+}
+
+/* ---- segmented buffer ----
+   Decompressed LVZ bytes as a chain of separately allocated segments, so
+   growing never copies what is already there and no allocation has to
+   hold the whole stream. A single Blob (a mapping or one heap buffer)
+   can stand in as the only segment. */
+
+#define SEG_SIZE (8u << 20)
+
+typedef struct {
+    uint8_t* p;
+    size_t len, cap;
+} Seg;
+
+typedef struct {
+    Seg* seg;
+    size_t nseg, cap;
+    size_t len;       /* bytes over all segments */
+    Blob whole;       /* owner of seg[0] when it was adopted */
+} SegBuf;
+
+static void segbuf_init(SegBuf* sb) {
+    memset(sb, 0, sizeof(*sb));
+}
+
+static void segbuf_free(SegBuf* sb) {
+    if (sb->whole.data) blob_release(&sb->whole);
+    else for (size_t k = 0; k < sb->nseg; ++k) big_free(sb->seg[k].p);
+    free(sb->seg);
+    segbuf_init(sb);
+}
+
+static Seg* segbuf_push(SegBuf* sb, uint8_t* p, size_t len, size_t cap) {
+    if (sb->nseg == sb->cap) {
+        sb->cap = sb->cap ? sb->cap * 2 : 16;
+        sb->seg = (Seg*)xrealloc(sb->seg, sb->cap * sizeof(Seg));
+    }
+    Seg* g = &sb->seg[sb->nseg++];
+    g->p = p; g->len = len; g->cap = cap;
+    sb->len += len;
+    return g;
+}
+
+/* take over b as the only segment; b is left empty */
+static void segbuf_adopt(SegBuf* sb, Blob* b) {
+    segbuf_init(sb);
+    sb->whole = *b;
+    if (b->len) segbuf_push(sb, (uint8_t*)b->data, b->len, b->len);
+    b->data = NULL; b->len = 0; b->mapped = 0;
+}
+
+/* room at the end: the last segment's free space, or a new segment of
+   want bytes (SEG_SIZE if 0) */
+static uint8_t* segbuf_room(SegBuf* sb, size_t want, size_t* avail) {
+    Seg* g = sb->nseg ? &sb->seg[sb->nseg - 1] : NULL;
+    if (!g || g->len == g->cap) {
+        size_t cap = want ? want : SEG_SIZE;
+        g = segbuf_push(sb, (uint8_t*)big_alloc(cap), 0, cap);
+    }
+    *avail = g->cap - g->len;
+    return g->p + g->len;
+}
+
+static void segbuf_commit(SegBuf* sb, size_t n) {
+    sb->seg[sb->nseg - 1].len += n;
+    sb->len += n;
+}
+
+/* copy up to n bytes at off into dst across segment boundaries; returns
+   the count copied (short at the end of the data) */
+static size_t segbuf_read(const SegBuf* sb, size_t off, uint8_t* dst, size_t n) {
+    size_t got = 0, base = 0;
+    for (size_t k = 0; k < sb->nseg && got < n; ++k) {
+        const Seg* g = &sb->seg[k];
+        if (off < base + g->len) {
+            size_t at = off - base, m = g->len - at;
+            if (m > n - got) m = n - got;
+            memcpy(dst + got, g->p + at, m);
+            got += m; off += m;
+        }
+        base += g->len;
+    }
+    return got;
+}
+
+/* same bytes, however they are split into segments */
+static int segbuf_same(const SegBuf* a, const SegBuf* b) {
+    if (a->len != b->len) return 0;
+    size_t i = 0, j = 0, ai = 0, bj = 0;
+    while (i < a->nseg && j < b->nseg) {
+        const Seg* x = &a->seg[i];
+        const Seg* y = &b->seg[j];
+        size_t m = x->len - ai < y->len - bj ? x->len - ai : y->len - bj;
+        if (memcmp(x->p + ai, y->p + bj, m) != 0) return 0;
+        ai += m; bj += m;
+        if (ai == x->len) { ++i; ai = 0; }
+        if (bj == y->len) { ++j; bj = 0; }
+    }
+    return 1;
+}
+
 static void make_dir_if_needed(const char* path) {
 #ifdef _WIN32
     CreateDirectoryA(path, NULL); /* ok if exists */
@@ -158,210 +862,3658 @@ static void out_dir_default(const char* lvz_path, char* out, size_t outsz) {
     else snprintf(out, outsz, "out_wrld");
 }
 
+typedef enum { LVZ_STORED = 0, LVZ_ZLIB, LVZ_GZIP, LVZ_RAW } LvzFormat;
+
+static const char* lvz_format_name(LvzFormat f) {
+    switch (f) {
+    case LVZ_ZLIB: return "zlib";
+    case LVZ_GZIP: return "gzip";
+    case LVZ_RAW:  return "raw deflate";
+    default:       return "stored";
+    }
+}
+
+static int lvz_window_bits(LvzFormat f) {
+    return f == LVZ_ZLIB ? 15 : f == LVZ_GZIP ? 16 + 15 : -15;
+}
+
+/* RFC 1950: CM=8, CINFO<=7, no preset dictionary, CMF*256+FLG divisible by 31 */
 static int looks_like_zlib(const uint8_t* b, size_t n) {
     if (n < 2) return 0;
-    return b[0] == 0x78 && (b[1] == 0x01 || b[1] == 0x9C || b[1] == 0xDA);
+    if ((b[0] & 0x0F) != 8 || (b[0] >> 4) > 7) return 0;
+    if (b[1] & 0x20) return 0;
+    return (((unsigned)b[0] << 8) | b[1]) % 31 == 0;
 }
 
-/* inflate with windowBits; return 0 on success */
-static int try_inflate(const uint8_t* in, size_t in_len, int window_bits,
-                       uint8_t** out_data, size_t* out_len) {
-    int ret;
+/* RFC 1952 magic plus CM=8 */
+static int looks_like_gzip(const uint8_t* b, size_t n) {
+    return n >= 10 && b[0] == 0x1F && b[1] == 0x8B && b[2] == 8;
+}
+
+/* decode only the first deflate block; 1 if it ends cleanly (or the input
+   runs out before any error). strm must be initialised. */
+static int probe_raw_deflate(z_stream* strm, const uint8_t* in, size_t in_len) {
+    uint8_t scratch[16384];
+    if (inflateReset2(strm, -15) != Z_OK) return 0;
+    strm->next_in = (Bytef*)in;
+    strm->avail_in = (unsigned)in_len;
+    for (;;) {
+        strm->next_out = scratch;
+        strm->avail_out = sizeof(scratch);
+        int ret = inflate(strm, Z_BLOCK);
+        if (ret == Z_STREAM_END) return 1;
+        if (ret != Z_OK && ret != Z_BUF_ERROR) return 0;
+        if (strm->data_type & 128) return 1;            /* end of first block */
+        if (strm->avail_in == 0) return strm->total_out > 0;
+        if (ret == Z_BUF_ERROR) return 0;
+    }
+}
+
+/* pick the container from its first bytes */
+static LvzFormat detect_lvz_format(z_stream* strm, const uint8_t* in, size_t in_len) {
+    if (looks_like_gzip(in, in_len)) return LVZ_GZIP;
+    if (looks_like_zlib(in, in_len)) return LVZ_ZLIB;
+    if (probe_raw_deflate(strm, in, in_len)) return LVZ_RAW;
+    return LVZ_STORED;
+}
+
+/* detect_lvz_format without a caller-owned stream */
+static LvzFormat sniff_lvz_format(const uint8_t* in, size_t in_len) {
     z_stream strm; memset(&strm, 0, sizeof(strm));
-    ret = inflateInit2(&strm, window_bits);
-    if (ret != Z_OK) return -1;
+    if (inflateInit2(&strm, -15) != Z_OK) return LVZ_STORED;
+    LvzFormat fmt = detect_lvz_format(&strm, in, in_len);
+    inflateEnd(&strm);
+    return fmt;
+}
+
+/* gzip ISIZE trailer: output length mod 2^32; 0 if it cannot be the real size */
+static size_t gzip_isize(const uint8_t* in, size_t in_len) {
+    if (in_len < 18) return 0;
+    u64 isize = read_u32le(in, in_len - 4);
+    /* deflate expands at most ~1032:1; anything smaller has wrapped past 4 GiB */
+    if (isize == 0 || isize * 1032ull < (u64)(in_len - 18)) return 0;
+    return (size_t)isize;
+}
 
-    size_t cap = in_len * 3 + 1024;
-    if (cap < 4096) cap = 4096;
-    uint8_t* out = (uint8_t*)xmalloc(cap);
+/* decode into a scratch buffer only to learn the output length */
+static int inflate_measure(z_stream* strm, const uint8_t* in, size_t in_len, int window_bits,
+                           size_t* out_len) {
+    uint8_t scratch[65536];
+    if (inflateReset2(strm, window_bits) != Z_OK) return -1;
+    strm->next_in = (Bytef*)in;
+    strm->avail_in = (unsigned)in_len;
     size_t total = 0;
+    for (;;) {
+        strm->next_out = scratch;
+        strm->avail_out = sizeof(scratch);
+        int ret = inflate(strm, Z_NO_FLUSH);
+        total += sizeof(scratch) - strm->avail_out;
+        if (ret == Z_STREAM_END) break;
+        if (ret != Z_OK) return -2;
+    }
+    *out_len = total;
+    return 0;
+}
 
-    strm.next_in = (Bytef*)in;
-    strm.avail_in = (unsigned)in_len;
+/* inflate with windowBits on an initialised stream into segments; return
+   0 on success. size_hint, when non-zero, sizes the first segment one
+   byte past the hint so zlib can reach the end of the stream without
+   running out of room, so a right hint gives one buffer; a wrong one only
+   adds SEG_SIZE segments, and nothing decoded so far is ever copied. */
+static int try_inflate(z_stream* strm, const uint8_t* in, size_t in_len, int window_bits,
+                       size_t size_hint, SegBuf* out) {
+    segbuf_init(out);
+    if (inflateReset2(strm, window_bits) != Z_OK) return -1;
+    strm->next_in = (Bytef*)in;
+    strm->avail_in = (unsigned)in_len;
 
+    size_t want = size_hint ? size_hint + 1 : 0;
     for (;;) {
-        if (total == cap) {
-            cap = cap * 2 + 8192;
-            out = (uint8_t*)xrealloc(out, cap);
-        }
-        strm.next_out = out + total;
-        strm.avail_out = (unsigned)(cap - total);
-
-        ret = inflate(&strm, Z_NO_FLUSH);
-        if (ret == Z_STREAM_END) {
-            total = cap - strm.avail_out;
-            break;
-        }
+        size_t avail;
+        uint8_t* dst = segbuf_room(out, want, &avail);
+        want = 0;
+        if (avail > (1u << 30)) avail = 1u << 30;
+        strm->next_out = dst;
+        strm->avail_out = (unsigned)avail;
+        int ret = inflate(strm, Z_NO_FLUSH);
+        segbuf_commit(out, avail - strm->avail_out);
+        if (ret == Z_STREAM_END) break;
         if (ret != Z_OK) {
-            inflateEnd(&strm);
-            free(out);
+            segbuf_free(out);
             return -2;
         }
-        total = cap - strm.avail_out;
     }
-
-    inflateEnd(&strm);
-    *out_data = out; *out_len = total;
     return 0;
 }
 
-/* Try zlib, then gzip, then raw; else return copy of input */
-static void maybe_decompress_lvz(const uint8_t* in, size_t in_len,
-                                 uint8_t** out, size_t* out_len) {
-    int ok; uint8_t* d = NULL; size_t n = 0;
+/* ---- built-in one-shot deflate decoder ----
+   Table-driven Huffman decoding from a 64-bit bit buffer with word-sized
+   match copies, for whole streams already in memory. Output goes to a
+   buffer that grows as needed; a correct size hint avoids any regrowth. */
 
-    ok = try_inflate(in, in_len, 15, &d, &n);          /* zlib */
-    if (ok == 0) { *out = d; *out_len = n; return; }
+#define DFL_LITLEN_BITS 10
+#define DFL_DIST_BITS   8
+#define DFL_PRE_BITS    7
+/* main table plus room for one 2^(15-bits) subtable per long codeword */
+#define DFL_LITLEN_SIZE ((1u << DFL_LITLEN_BITS) + 288u * (1u << (15 - DFL_LITLEN_BITS)))
+#define DFL_DIST_SIZE   ((1u << DFL_DIST_BITS) + 32u * (1u << (15 - DFL_DIST_BITS)))
+#define DFL_PRE_SIZE    (1u << DFL_PRE_BITS)
+#define DFL_MARGIN      (258 + 8)   /* longest match plus word-copy overshoot */
 
-    ok = try_inflate(in, in_len, 16 + 15, &d, &n);     /* gzip */
-    if (ok == 0) { *out = d; *out_len = n; return; }
+/* table entry: bits 0-3 bits to consume, 4-7 extra bits (subtable index
+   bits for DFL_SUB), 8-15 kind, 16-31 value */
+enum { DFL_LIT = 0, DFL_LEN, DFL_EOB, DFL_SUB, DFL_BAD };
+#define DFL_ENTRY(kind, val, extra) (((uint32_t)(val) << 16) | ((uint32_t)(kind) << 8) | ((uint32_t)(extra) << 4))
+#define DFL_KIND(e)  (((e) >> 8) & 0xFF)
+#define DFL_VAL(e)   ((e) >> 16)
+#define DFL_EXTRA(e) (((e) >> 4) & 0xF)
 
-    ok = try_inflate(in, in_len, -15, &d, &n);         /* raw DEFLATE */
-    if (ok == 0) { *out = d; *out_len = n; return; }
+static const uint16_t dfl_len_base[29] = {
+    3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258 };
+static const uint8_t dfl_len_extra[29] = {
+    0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0 };
+static const uint16_t dfl_dist_base[30] = {
+    1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,
+    1025,1537,2049,3073,4097,6145,8193,12289,16385,24577 };
+static const uint8_t dfl_dist_extra[30] = {
+    0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
+static const uint8_t dfl_pre_order[19] = {
+    16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15 };
 
-    d = (uint8_t*)xmalloc(in_len);
-    memcpy(d, in, in_len);
-    *out = d; *out_len = in_len;
-}
+typedef struct {
+    const uint8_t* in;
+    const uint8_t* in_begin;
+    const uint8_t* in_end;
+    u64 bitbuf;
+    unsigned bitsleft;
+    size_t overrun;         /* zero bytes fed past the end of input */
+    uint8_t* out;
+    uint16_t* sout;         /* symbolic output (parallel inflate), else NULL */
+    size_t pos, cap;        /* in elements of whichever output is active */
+    uint32_t litlen[DFL_LITLEN_SIZE];
+    uint32_t dist[DFL_DIST_SIZE];
+    uint32_t pre[DFL_PRE_SIZE];
+} Dfl;
 
-/* dynamic list of headers */
-static void header_list_init(HeaderList* hl) {
-    hl->items = NULL; hl->count = 0; hl->cap = 0;
+static uint64_t load_u64le(const uint8_t* p) {
+    uint64_t v; memcpy(&v, p, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
 }
-static void header_list_push(HeaderList* hl, WrldHeader h) {
-    if (hl->count == hl->cap) {
-        hl->cap = hl->cap ? hl->cap * 2 : 128;
-        hl->items = (WrldHeader*)xrealloc(hl->items, hl->cap * sizeof(WrldHeader));
+
+/* top up the bit buffer to at least 56 bits */
+static void dfl_refill(Dfl* z) {
+    if (z->bitsleft >= 56) return;
+    if (z->in_end - z->in >= 8) {
+        z->bitbuf |= load_u64le(z->in) << z->bitsleft;
+        z->in += (63 - z->bitsleft) >> 3;
+        z->bitsleft |= 56;
+    } else {
+        while (z->bitsleft <= 56) {
+            if (z->in < z->in_end) z->bitbuf |= (u64)*z->in++ << z->bitsleft;
+            else z->overrun++;
+            z->bitsleft += 8;
+        }
     }
-    hl->items[hl->count++] = h;
 }
-static int cmp_by_lvz_off(const void* a, const void* b) {
-    const WrldHeader* x = (const WrldHeader*)a;
-    const WrldHeader* y = (const WrldHeader*)b;
-    if (x->lvz_off < y->lvz_off) return -1;
-    if (x->lvz_off > y->lvz_off) return 1;
-    return 0;
+
+static uint32_t dfl_bits(Dfl* z, unsigned n) {
+    uint32_t v = (uint32_t)(z->bitbuf & ((1ull << n) - 1));
+    z->bitbuf >>= n; z->bitsleft -= n;
+    return v;
 }
 
-static void scan_slave_headers(const uint8_t* d, size_t n, HeaderList* out, FILE* log) {
-    header_list_init(out);
-    size_t i = 0;
-    size_t hits = 0;
-    while (1) {
-        size_t j = i;
-        for (; j + 4 <= n; ++j) {
-            if (d[j]=='D' && d[j+1]=='L' && d[j+2]=='R' && d[j+3]=='W') break;
-        }
-        if (j + 32 > n) break;
+static void dfl_reserve(Dfl* z, size_t need) {
+    if (z->cap - z->pos >= need) return;
+    size_t cap = z->cap * 2;
+    if (cap < z->pos + need) cap = z->pos + need;
+    if (z->sout) z->sout = (uint16_t*)xrealloc(z->sout, cap * sizeof(uint16_t));
+    else z->out = (uint8_t*)big_grow(z->out, z->pos, cap);
+    z->cap = cap;
+}
 
-        uint32_t wrld_type = read_u32le(d, j+0x04);
-        uint32_t total     = read_u32le(d, j+0x08);
-        uint32_t g0        = read_u32le(d, j+0x0C);
-        uint32_t g1        = read_u32le(d, j+0x10);
-        uint32_t gcnt      = read_u32le(d, j+0x14);
-        uint32_t cont      = read_u32le(d, j+0x18);
+/* canonical Huffman table from code lengths; tmpl[s] is the entry for
+   symbol s without its bit count. Mirrors zlib: over-subscribed sets are
+   rejected, incomplete ones only allowed for a single 1-bit code. */
+static int dfl_build(uint32_t* table, unsigned tb, const uint8_t* lens, unsigned nsym,
+                     const uint32_t* tmpl, int allow_single) {
+    unsigned count[16] = {0}, offs[16];
+    uint16_t sorted[288];
+    for (unsigned s = 0; s < nsym; ++s) count[lens[s]]++;
+    count[0] = 0;
+    unsigned max = 15;
+    while (max > 0 && count[max] == 0) --max;
+
+    int left = 1;
+    for (unsigned len = 1; len <= 15; ++len) {
+        left <<= 1;
+        left -= (int)count[len];
+        if (left < 0) return -1;
+    }
+    if (max && left > 0 && (!allow_single || max != 1)) return -1;
+
+    unsigned main_size = 1u << tb;
+    for (unsigned k = 0; k < main_size; ++k) table[k] = DFL_ENTRY(DFL_BAD, 0, 0);
+    if (max == 0) return 0;
+
+    offs[1] = 0;
+    for (unsigned len = 1; len < 15; ++len) offs[len + 1] = offs[len] + count[len];
+    for (unsigned s = 0; s < nsym; ++s)
+        if (lens[s]) sorted[offs[lens[s]]++] = (uint16_t)s;
+
+    unsigned code = 0, i = 0, sub_next = main_size, sub_bits = 0;
+    int prefix = -1;
+    unsigned sub_start = 0;
+    for (unsigned len = 1; len <= max; ++len) {
+        for (unsigned c = 0; c < count[len]; ++c, ++code) {
+            unsigned s = sorted[i++];
+            unsigned rev = 0;
+            for (unsigned b = 0; b < len; ++b) rev |= ((code >> b) & 1u) << (len - 1 - b);
+            if (len <= tb) {
+                for (unsigned k = rev; k < main_size; k += 1u << len) table[k] = tmpl[s] | len;
+                continue;
+            }
+            unsigned p = rev & (main_size - 1);
+            if ((int)p != prefix) {
+                prefix = (int)p;
+                sub_bits = max - tb;
+                sub_start = sub_next;
+                sub_next += 1u << sub_bits;
+                for (unsigned k = 0; k < (1u << sub_bits); ++k)
+                    table[sub_start + k] = DFL_ENTRY(DFL_BAD, 0, 0);
+                table[p] = DFL_ENTRY(DFL_SUB, sub_start, sub_bits) | tb;
+            }
+            for (unsigned k = rev >> tb; k < (1u << sub_bits); k += 1u << (len - tb))
+                table[sub_start + k] = tmpl[s] | (len - tb);
+        }
+        code <<= 1;
+    }
+    return 0;
+}
+
+static int dfl_build_litlen(Dfl* z, const uint8_t* lens, unsigned nsym) {
+    uint32_t tmpl[288];
+    for (unsigned s = 0; s < 288; ++s) {
+        if (s < 256) tmpl[s] = DFL_ENTRY(DFL_LIT, s, 0);
+        else if (s == 256) tmpl[s] = DFL_ENTRY(DFL_EOB, 0, 0);
+        else if (s < 286) tmpl[s] = DFL_ENTRY(DFL_LEN, dfl_len_base[s - 257], dfl_len_extra[s - 257]);
+        else tmpl[s] = DFL_ENTRY(DFL_BAD, 0, 0);
+    }
+    return dfl_build(z->litlen, DFL_LITLEN_BITS, lens, nsym, tmpl, 1);
+}
+
+static int dfl_build_dist(Dfl* z, const uint8_t* lens, unsigned nsym) {
+    uint32_t tmpl[32];
+    for (unsigned s = 0; s < 32; ++s)
+        tmpl[s] = s < 30 ? DFL_ENTRY(DFL_LIT, dfl_dist_base[s], dfl_dist_extra[s])
+                         : DFL_ENTRY(DFL_BAD, 0, 0);
+    return dfl_build(z->dist, DFL_DIST_BITS, lens, nsym, tmpl, 1);
+}
+
+static int dfl_read_dynamic(Dfl* z) {
+    uint8_t lens[288 + 32];
+    uint8_t pre_lens[19] = {0};
+    uint32_t pre_tmpl[19];
+
+    dfl_refill(z);
+    unsigned hlit = dfl_bits(z, 5) + 257;
+    unsigned hdist = dfl_bits(z, 5) + 1;
+    unsigned hclen = dfl_bits(z, 4) + 4;
+    if (hlit > 286 || hdist > 30) return -1;
+    for (unsigned k = 0; k < hclen; ++k) {
+        if (z->bitsleft < 3) dfl_refill(z);
+        pre_lens[dfl_pre_order[k]] = (uint8_t)dfl_bits(z, 3);
+    }
+    for (unsigned s = 0; s < 19; ++s) pre_tmpl[s] = DFL_ENTRY(DFL_LIT, s, 0);
+    if (dfl_build(z->pre, DFL_PRE_BITS, pre_lens, 19, pre_tmpl, 0) != 0) return -1;
+
+    unsigned n = 0, total = hlit + hdist;
+    while (n < total) {
+        if (z->bitsleft < 14) dfl_refill(z);
+        uint32_t e = z->pre[z->bitbuf & (DFL_PRE_SIZE - 1)];
+        if (DFL_KIND(e) == DFL_BAD) return -1;
+        dfl_bits(z, e & 15);
+        unsigned sym = DFL_VAL(e);
+        unsigned rep, val;
+        if (sym < 16) { lens[n++] = (uint8_t)sym; continue; }
+        if (sym == 16) {
+            if (n == 0) return -1;
+            val = lens[n - 1]; rep = 3 + dfl_bits(z, 2);
+        } else if (sym == 17) {
+            val = 0; rep = 3 + dfl_bits(z, 3);
+        } else {
+            val = 0; rep = 11 + dfl_bits(z, 7);
+        }
+        if (n + rep > total) return -1;
+        while (rep--) lens[n++] = (uint8_t)val;
+    }
+    if (lens[256] == 0) return -1;
+    if (dfl_build_litlen(z, lens, hlit) != 0) return -1;
+    if (dfl_build_dist(z, lens + hlit, hdist) != 0) return -1;
+    return 0;
+}
+
+static void dfl_build_fixed(Dfl* z) {
+    uint8_t lens[288];
+    unsigned s = 0;
+    for (; s < 144; ++s) lens[s] = 8;
+    for (; s < 256; ++s) lens[s] = 9;
+    for (; s < 280; ++s) lens[s] = 7;
+    for (; s < 288; ++s) lens[s] = 8;
+    dfl_build_litlen(z, lens, 288);
+    for (s = 0; s < 32; ++s) lens[s] = 5;
+    dfl_build_dist(z, lens, 32);
+}
+
+static int dfl_huffman_block(Dfl* z) {
+    const uint32_t* litlen = z->litlen;
+    const uint32_t* dist = z->dist;
+    /* hot state lives in locals so stores to out cannot alias it */
+    u64 bitbuf = z->bitbuf;
+    unsigned bitsleft = z->bitsleft;
+    const uint8_t* in = z->in;
+    const uint8_t* in_end = z->in_end;
+    uint8_t* out = z->out;
+    size_t pos = z->pos, cap = z->cap;
+    int rc = 0;
+
+    for (;;) {
+        if (cap - pos < DFL_MARGIN) {
+            z->pos = pos;
+            dfl_reserve(z, DFL_MARGIN);
+            out = z->out; cap = z->cap;
+        }
+        if (bitsleft < 48) {
+            if (in_end - in >= 8) {
+                bitbuf |= load_u64le(in) << bitsleft;
+                in += (63 - bitsleft) >> 3;
+                bitsleft |= 56;
+            } else {
+                z->bitbuf = bitbuf; z->bitsleft = bitsleft; z->in = in;
+                dfl_refill(z);
+                bitbuf = z->bitbuf; bitsleft = z->bitsleft; in = z->in;
+                if (z->overrun > 8) { rc = -2; break; }
+            }
+        }
+
+        uint32_t e = litlen[bitbuf & ((1u << DFL_LITLEN_BITS) - 1)];
+        if (DFL_KIND(e) == DFL_SUB) {
+            bitbuf >>= DFL_LITLEN_BITS; bitsleft -= DFL_LITLEN_BITS;
+            e = litlen[DFL_VAL(e) + (bitbuf & ((1u << DFL_EXTRA(e)) - 1))];
+        }
+        bitbuf >>= e & 15; bitsleft -= e & 15;
+
+        unsigned kind = DFL_KIND(e);
+        if (kind == DFL_LIT) {
+            out[pos++] = (uint8_t)DFL_VAL(e);
+            /* literal runs: keep decoding while the buffer still holds a full code */
+            while (bitsleft >= 15) {
+                e = litlen[bitbuf & ((1u << DFL_LITLEN_BITS) - 1)];
+                if (DFL_KIND(e) != DFL_LIT) break;
+                bitbuf >>= e & 15; bitsleft -= e & 15;
+                out[pos++] = (uint8_t)DFL_VAL(e);
+            }
+            continue;
+        }
+        if (kind == DFL_EOB) break;
+        if (kind != DFL_LEN) { rc = -1; break; }
+
+        unsigned ex = DFL_EXTRA(e);
+        unsigned len = DFL_VAL(e) + (unsigned)(bitbuf & ((1u << ex) - 1));
+        bitbuf >>= ex; bitsleft -= ex;
+
+        uint32_t d = dist[bitbuf & ((1u << DFL_DIST_BITS) - 1)];
+        if (DFL_KIND(d) == DFL_SUB) {
+            bitbuf >>= DFL_DIST_BITS; bitsleft -= DFL_DIST_BITS;
+            d = dist[DFL_VAL(d) + (bitbuf & ((1u << DFL_EXTRA(d)) - 1))];
+        }
+        if (DFL_KIND(d) == DFL_BAD) { rc = -1; break; }
+        bitbuf >>= d & 15; bitsleft -= d & 15;
+        ex = DFL_EXTRA(d);
+        size_t off = DFL_VAL(d) + (size_t)(bitbuf & ((1u << ex) - 1));
+        bitbuf >>= ex; bitsleft -= ex;
+        if (off > pos) { rc = -1; break; }
+
+        uint8_t* dst = out + pos;
+        const uint8_t* src = dst - off;
+        pos += len;
+        if (off >= 8) {
+            uint8_t* end = dst + len;
+            do { memcpy(dst, src, 8); dst += 8; src += 8; } while (dst < end);
+        } else if (off == 1) {
+            memset(dst, *src, len);
+        } else {
+            while (len--) *dst++ = *src++;
+        }
+    }
+
+    z->bitbuf = bitbuf; z->bitsleft = bitsleft; z->in = in; z->pos = pos;
+    return rc;
+}
+
+static int dfl_stored_block(Dfl* z) {
+    /* drop to the byte boundary and rewind the input to it */
+    z->bitbuf >>= z->bitsleft & 7; z->bitsleft &= ~7u;
+    size_t back = z->bitsleft / 8;
+    if (back < z->overrun) return -2;
+    z->in -= back - z->overrun;
+    z->bitbuf = 0; z->bitsleft = 0; z->overrun = 0;
+
+    if (z->in_end - z->in < 4) return -2;
+    unsigned len = (unsigned)z->in[0] | ((unsigned)z->in[1] << 8);
+    unsigned nlen = (unsigned)z->in[2] | ((unsigned)z->in[3] << 8);
+    if (len != (~nlen & 0xFFFF)) return -1;
+    z->in += 4;
+    if ((size_t)(z->in_end - z->in) < len) return -2;
+    dfl_reserve(z, len + DFL_MARGIN);
+    if (z->sout) {
+        for (unsigned k = 0; k < len; ++k) z->sout[z->pos + k] = z->in[k];
+    } else {
+        memcpy(z->out + z->pos, z->in, len);
+    }
+    z->pos += len; z->in += len;
+    return 0;
+}
+
+/* decode one raw deflate stream; *consumed is set to the byte just past it.
+   0 = ok, -1 = bad data, -2 = truncated */
+static int dfl_decode(Dfl* z, const uint8_t* in, size_t in_len, size_t* consumed) {
+    z->in = z->in_begin = in; z->in_end = in + in_len;
+    z->bitbuf = 0; z->bitsleft = 0; z->overrun = 0;
+    int fixed_built = 0, last;
+    do {
+        dfl_refill(z);
+        last = (int)dfl_bits(z, 1);
+        unsigned type = dfl_bits(z, 2);
+        int rc;
+        if (type == 0) rc = dfl_stored_block(z);
+        else if (type == 1) {
+            if (!fixed_built) { dfl_build_fixed(z); fixed_built = 1; }
+            rc = dfl_huffman_block(z);
+        } else if (type == 2) {
+            fixed_built = 0;
+            rc = dfl_read_dynamic(z);
+            if (rc == 0) rc = dfl_huffman_block(z);
+        } else rc = -1;
+        if (rc != 0) return rc;
+        if (z->overrun > 8) return -2;
+    } while (!last);
+
+    /* unused whole bytes left in the bit buffer go back to the input */
+    size_t back = (z->bitsleft & ~7u) / 8;
+    if (back < z->overrun) return -2;
+    *consumed = (size_t)(z->in - z->in_begin) - (back - z->overrun);
+    return 0;
+}
+
+/* zlib checksums over buffers that may exceed uInt */
+static uint32_t adler32_all(const uint8_t* p, size_t n) {
+    uLong a = adler32(0, NULL, 0);
+    while (n) {
+        uInt k = n > (1u << 30) ? (1u << 30) : (uInt)n;
+        a = adler32(a, p, k); p += k; n -= k;
+    }
+    return (uint32_t)a;
+}
+
+static uint32_t crc32_all(const uint8_t* p, size_t n) {
+    uLong c = crc32(0, NULL, 0);
+    while (n) {
+        uInt k = n > (1u << 30) ? (1u << 30) : (uInt)n;
+        c = crc32(c, p, k); p += k; n -= k;
+    }
+    return (uint32_t)c;
+}
+
+/* offset of the raw deflate data inside a zlib/gzip/raw container */
+static int lvz_deflate_start(LvzFormat fmt, const uint8_t* in, size_t in_len, size_t* hdr_out) {
+    size_t hdr = 0;
+    if (fmt == LVZ_ZLIB) {
+        if (!looks_like_zlib(in, in_len)) return -1;
+        hdr = 2;
+    } else if (fmt == LVZ_GZIP) {
+        if (!looks_like_gzip(in, in_len)) return -1;
+        uint8_t flg = in[3];
+        hdr = 10;
+        if (flg & 4) {
+            if (hdr + 2 > in_len) return -2;
+            hdr += 2 + ((size_t)in[hdr] | ((size_t)in[hdr + 1] << 8));
+        }
+        if (flg & 8) { while (hdr < in_len && in[hdr]) ++hdr; ++hdr; }
+        if (flg & 16) { while (hdr < in_len && in[hdr]) ++hdr; ++hdr; }
+        if (flg & 2) hdr += 2;
+        if (hdr > in_len) return -2;
+    }
+    *hdr_out = hdr;
+    return 0;
+}
+
+/* verify the zlib/gzip trailer that starts at in+tail against the output */
+static int lvz_check_trailer(LvzFormat fmt, const uint8_t* in, size_t in_len, size_t tail,
+                             const uint8_t* out, size_t out_len) {
+    if (fmt == LVZ_ZLIB) {
+        if (tail + 4 > in_len) return -2;
+        uint32_t want = ((uint32_t)in[tail] << 24) | ((uint32_t)in[tail+1] << 16)
+                      | ((uint32_t)in[tail+2] << 8) | in[tail+3];
+        if (adler32_all(out, out_len) != want) return -1;
+    } else if (fmt == LVZ_GZIP) {
+        if (tail + 8 > in_len) return -2;
+        if (crc32_all(out, out_len) != read_u32le(in, tail)
+            || read_u32le(in, tail + 4) != (uint32_t)out_len) return -1;
+    }
+    return 0;
+}
+
+/* zlib/gzip framing around dfl_decode, with checksum verification */
+static int dfl_inflate_lvz(LvzFormat fmt, const uint8_t* in, size_t in_len, size_t size_hint,
+                           uint8_t** out, size_t* out_len) {
+    size_t hdr = 0;
+    int rc = lvz_deflate_start(fmt, in, in_len, &hdr);
+    if (rc != 0) return rc;
+
+    Dfl* z = (Dfl*)xmalloc(sizeof(Dfl));
+    z->cap = (size_hint ? size_hint : in_len * 3 + 1024) + DFL_MARGIN;
+    z->out = (uint8_t*)big_alloc(z->cap);
+    z->sout = NULL;
+    z->pos = 0;
+    size_t used = 0;
+    rc = dfl_decode(z, in + hdr, in_len - hdr, &used);
+    if (rc == 0) rc = lvz_check_trailer(fmt, in, in_len, hdr + used, z->out, z->pos);
+    if (rc != 0) { big_free(z->out); free(z); return rc; }
+    *out = z->out; *out_len = z->pos;
+    free(z);
+    return 0;
+}
+
+/* ---- speculative parallel inflate ----
+   pugz-style decoding of one deflate stream on several threads. Chunks
+   after the first start at a guessed dynamic-block boundary and decode
+   without their 32 KiB window; bytes copied from that window are kept as
+   16-bit markers (256 + window index) and patched once the preceding
+   output is known. A guess is accepted only if the previous chunk ends
+   exactly on it, which proves it by induction from chunk 0. Anything
+   else falls back to a serial decode. Each search is limited to a window
+   past the split point, and the first one to come up empty stops the rest:
+   streams of fixed or stored blocks have no boundaries to find. */
+
+#define PAR_MIN_CHUNK   (1u << 20)    /* compressed bytes per chunk */
+#define PAR_FIND_WINDOW (128u << 10)  /* most compressed bytes searched for a block start */
+#define PAR_FIND_POLL   4096u         /* bits between checks for a failed search */
+#define DFL_WSIZE       32768u
+
+static u64 dfl_bitpos(const Dfl* z) {
+    return ((u64)(z->in - z->in_begin) + z->overrun) * 8 - z->bitsleft;
+}
+
+static void dfl_seek_bit(Dfl* z, const uint8_t* in, size_t in_len, u64 bit) {
+    z->in_begin = in; z->in_end = in + in_len;
+    z->in = in + (bit >> 3);
+    z->bitbuf = 0; z->bitsleft = 0; z->overrun = 0;
+    dfl_refill(z);
+    dfl_bits(z, (unsigned)(bit & 7));
+}
+
+/* dfl_huffman_block writing 16-bit symbols; references that reach before
+   the chunk start become window markers */
+static int dfl_huffman_block_sym(Dfl* z) {
+    const uint32_t* litlen = z->litlen;
+    const uint32_t* dist = z->dist;
+    for (;;) {
+        if (z->cap - z->pos < DFL_MARGIN) dfl_reserve(z, DFL_MARGIN);
+        if (z->bitsleft < 48) {
+            dfl_refill(z);
+            if (z->overrun > 8) return -2;
+        }
+        uint32_t e = litlen[z->bitbuf & ((1u << DFL_LITLEN_BITS) - 1)];
+        if (DFL_KIND(e) == DFL_SUB) {
+            dfl_bits(z, DFL_LITLEN_BITS);
+            e = litlen[DFL_VAL(e) + (z->bitbuf & ((1u << DFL_EXTRA(e)) - 1))];
+        }
+        dfl_bits(z, e & 15);
+
+        unsigned kind = DFL_KIND(e);
+        if (kind == DFL_LIT) { z->sout[z->pos++] = (uint16_t)DFL_VAL(e); continue; }
+        if (kind == DFL_EOB) return 0;
+        if (kind != DFL_LEN) return -1;
+
+        size_t len = DFL_VAL(e) + dfl_bits(z, DFL_EXTRA(e));
+        uint32_t d = dist[z->bitbuf & ((1u << DFL_DIST_BITS) - 1)];
+        if (DFL_KIND(d) == DFL_SUB) {
+            dfl_bits(z, DFL_DIST_BITS);
+            d = dist[DFL_VAL(d) + (z->bitbuf & ((1u << DFL_EXTRA(d)) - 1))];
+        }
+        if (DFL_KIND(d) == DFL_BAD) return -1;
+        dfl_bits(z, d & 15);
+        size_t off = DFL_VAL(d) + dfl_bits(z, DFL_EXTRA(d));
+
+        uint16_t* dst = z->sout + z->pos;
+        size_t i = 0;
+        if (off > z->pos) {
+            size_t pre = off - z->pos;
+            if (pre > DFL_WSIZE) return -1;
+            for (; i < len && i < pre; ++i) dst[i] = (uint16_t)(256 + DFL_WSIZE - pre + i);
+        }
+        for (; i < len; ++i) dst[i] = dst[(ptrdiff_t)i - (ptrdiff_t)off];
+        z->pos += len;
+    }
+}
+
+/* one block at the current position; *last gets BFINAL */
+static int dfl_block_sym(Dfl* z, int* last) {
+    dfl_refill(z);
+    *last = (int)dfl_bits(z, 1);
+    unsigned type = dfl_bits(z, 2);
+    if (type == 0) return dfl_stored_block(z);
+    if (type == 1) { dfl_build_fixed(z); return dfl_huffman_block_sym(z); }
+    if (type == 2) {
+        int rc = dfl_read_dynamic(z);
+        return rc ? rc : dfl_huffman_block_sym(z);
+    }
+    return -1;
+}
+
+/* is there a plausible dynamic block starting at this bit? The header must
+   build complete codes, the block must decode cleanly, and the next block
+   header must have a valid type. */
+static int dfl_probe_block(Dfl* z, const uint8_t* in, size_t in_len, u64 bit) {
+    size_t b = (size_t)(bit >> 3);
+    if (b + 3 > in_len) return 0;
+    uint32_t v = ((uint32_t)in[b] | ((uint32_t)in[b+1] << 8) | ((uint32_t)in[b+2] << 16)) >> (bit & 7);
+    if (((v >> 1) & 3) != 2) return 0;             /* BTYPE must be dynamic */
+    if (((v >> 3) & 31) > 29) return 0;            /* HLIT <= 286 */
+    if (((v >> 8) & 31) > 29) return 0;            /* HDIST <= 30 */
+
+    /* the precode lengths must form a complete code; checking that from the
+       raw bits rejects nearly every candidate before any table is built */
+    u64 pre = bit + 17;                            /* past BFINAL..HCLEN */
+    if ((size_t)(pre >> 3) + 8 <= in_len) {
+        u64 w = load_u64le(in + (pre >> 3)) >> (pre & 7);
+        w &= (1ull << (3 * (((v >> 13) & 15) + 4))) - 1;
+        unsigned kraft = 0;                         /* in units of 2^-7 */
+        for (unsigned k = 0; k < 19; ++k, w >>= 3) kraft += (128u >> (w & 7)) & 127u;
+        if (kraft != 128) return 0;
+    }
+
+    dfl_seek_bit(z, in, in_len, bit);
+    z->pos = 0;
+    int last;
+    if (dfl_block_sym(z, &last) != 0 || z->overrun) return 0;
+    if (last) return 1;
+    dfl_refill(z);
+    dfl_bits(z, 1);
+    return dfl_bits(z, 2) != 3;
+}
+
+/* shared between the searches: set once any of them gives up */
+typedef struct {
+    mutex_t mu;
+    int missed;
+} ParFind;
+
+typedef struct {
+    Dfl* z;
+    const uint8_t* in;
+    size_t in_len;
+    ParFind* find;
+    u64 from, to;          /* find: bit range to search for a block start */
+    u64 start, stop;       /* decode: [start, stop) in bits; stop 0 = to the end */
+    int rc;
+    size_t used;           /* bytes consumed, for the final chunk */
+    uint8_t* out;          /* resolve: output buffer and chunk placement */
+    size_t base, lo, hi;
+} ParChunk;
+
+static void* par_find_main(void* arg) {
+    ParChunk* c = (ParChunk*)arg;
+    for (u64 bit = c->from; bit < c->to; ++bit) {
+        if (dfl_probe_block(c->z, c->in, c->in_len, bit)) {
+            c->start = bit;
+            return NULL;
+        }
+        if ((bit - c->from) % PAR_FIND_POLL == 0) {
+            mutex_lock(&c->find->mu);
+            int missed = c->find->missed;
+            mutex_unlock(&c->find->mu);
+            if (missed) return NULL;
+        }
+    }
+    mutex_lock(&c->find->mu);
+    c->find->missed = 1;
+    mutex_unlock(&c->find->mu);
+    return NULL;
+}
+
+static void* par_decode_main(void* arg) {
+    ParChunk* c = (ParChunk*)arg;
+    Dfl* z = c->z;
+    dfl_seek_bit(z, c->in, c->in_len, c->start);
+    z->pos = 0;
+    for (;;) {
+        int last;
+        c->rc = dfl_block_sym(z, &last);
+        if (c->rc != 0) return NULL;
+        if (z->overrun > 8) { c->rc = -2; return NULL; }
+        u64 at = dfl_bitpos(z);
+        if (c->stop) {
+            if (at == c->stop) return NULL;
+            if (at > c->stop || last) { c->rc = -3; return NULL; }   /* missed the next guess */
+        } else if (last) {
+            size_t back = (z->bitsleft & ~7u) / 8;
+            if (back < z->overrun) { c->rc = -2; return NULL; }
+            c->used = (size_t)(z->in - z->in_begin) - (back - z->overrun);
+            return NULL;
+        }
+    }
+}
+
+/* patch symbols [lo, hi) of a chunk into bytes; the window before base
+   must already be final */
+static void* par_resolve_main(void* arg) {
+    ParChunk* c = (ParChunk*)arg;
+    const uint16_t* sym = c->z->sout;
+    uint8_t* out = c->out + c->base;
+    c->rc = 0;
+    for (size_t i = c->lo; i < c->hi; ++i) {
+        uint16_t v = sym[i];
+        if (v < 256) { out[i] = (uint8_t)v; continue; }
+        size_t w = (size_t)v - 256;
+        if (c->base + w < DFL_WSIZE) { c->rc = -1; return NULL; }  /* before stream start */
+        out[i] = c->out[c->base + w - DFL_WSIZE];
+    }
+    return NULL;
+}
+
+static void par_run(thread_fn fn, ParChunk* cs, size_t n) {
+    thread_t* tids = (thread_t*)xmalloc(n * sizeof(thread_t));
+    int* started = (int*)xmalloc(n * sizeof(int));
+    for (size_t k = 1; k < n; ++k) started[k] = thread_start(&tids[k], fn, &cs[k]) == 0;
+    fn(&cs[0]);
+    for (size_t k = 1; k < n; ++k) {
+        if (started[k]) thread_join(tids[k]);
+        else fn(&cs[k]);
+    }
+    free(started); free(tids);
+}
+
+/* 0 = decoded in parallel, 1 = caller should decode serially, <0 = error.
+   note receives a short description for the log. */
+static int par_inflate_lvz(LvzFormat fmt, const uint8_t* in, size_t in_len, int threads,
+                           uint8_t** out, size_t* out_len, char* note, size_t note_sz) {
+    size_t hdr = 0;
+    if (lvz_deflate_start(fmt, in, in_len, &hdr) != 0) return 1;
+    const uint8_t* raw = in + hdr;
+    size_t raw_len = in_len - hdr;
+    size_t n = threads > 0 ? (size_t)threads : (size_t)cpu_count();
+    if (n > raw_len / PAR_MIN_CHUNK) n = raw_len / PAR_MIN_CHUNK;
+    if (n < 2) { snprintf(note, note_sz, "serial (input too small to split)"); return 1; }
+
+    /* a search is an order of magnitude slower per byte than inflating, so
+       it may only cover a small share of the input */
+    size_t window = raw_len / 64 < PAR_FIND_WINDOW ? raw_len / 64 : PAR_FIND_WINDOW;
+    ParFind find;
+    mutex_init(&find.mu);
+    find.missed = 0;
+    ParChunk* cs = (ParChunk*)xmalloc(n * sizeof(ParChunk));
+    memset(cs, 0, n * sizeof(ParChunk));
+    for (size_t k = 0; k < n; ++k) {
+        cs[k].z = (Dfl*)xmalloc(sizeof(Dfl));
+        cs[k].z->out = NULL;
+        cs[k].z->cap = raw_len / n * 3 + DFL_MARGIN;
+        cs[k].z->sout = (uint16_t*)xmalloc(cs[k].z->cap * sizeof(uint16_t));
+        cs[k].in = raw; cs[k].in_len = raw_len;
+        cs[k].find = &find;
+        cs[k].from = (u64)(raw_len / n * k) * 8;
+        cs[k].to = cs[k].from + (u64)window * 8;
+    }
+
+    /* guess block boundaries for chunks 1..n-1; chunk 0 starts at bit 0 */
+    par_run(par_find_main, cs + 1, n - 1);
+    mutex_destroy(&find.mu);
+    cs[0].start = 0;
+    for (size_t k = 0; k < n; ++k) cs[k].stop = (k + 1 < n) ? cs[k + 1].start : 0;
+
+    int rc = 1;
+    if (!find.missed) {
+        par_run(par_decode_main, cs, n);
+        rc = 0;
+        for (size_t k = 0; k < n; ++k) if (cs[k].rc) rc = 1;
+        if (rc) snprintf(note, note_sz, "serial (a block-boundary guess did not hold)");
+    } else {
+        snprintf(note, note_sz, "serial (no block boundary near a split point)");
+    }
+
+    if (rc == 0) {
+        size_t total = 0;
+        for (size_t k = 0; k < n; ++k) { cs[k].base = total; total += cs[k].z->pos; }
+        uint8_t* buf = (uint8_t*)big_alloc(total);
+
+        /* the last 32 KiB of each chunk in order, then the rest in parallel */
+        for (size_t k = 0; k < n && rc == 0; ++k) {
+            size_t len = cs[k].z->pos;
+            cs[k].out = buf;
+            cs[k].lo = len > DFL_WSIZE ? len - DFL_WSIZE : 0;
+            cs[k].hi = len;
+            par_resolve_main(&cs[k]);
+            if (cs[k].rc) rc = 1;
+            cs[k].hi = cs[k].lo; cs[k].lo = 0;
+        }
+        if (rc == 0) {
+            par_run(par_resolve_main, cs, n);
+            for (size_t k = 0; k < n; ++k) if (cs[k].rc) rc = 1;
+        }
+        if (rc == 0 && lvz_check_trailer(fmt, in, in_len, hdr + cs[n - 1].used, buf, total) != 0)
+            rc = 1;
+        if (rc == 0) {
+            *out = buf; *out_len = total;
+            snprintf(note, note_sz, "parallel (%zu chunks)", n);
+        } else {
+            big_free(buf);
+            snprintf(note, note_sz, "serial (parallel result failed verification)");
+        }
+    }
+
+    for (size_t k = 0; k < n; ++k) { free(cs[k].z->sout); free(cs[k].z); }
+    free(cs);
+    return rc;
+}
+
+/* ---- inflate backends ---- */
+typedef struct {
+    z_stream* strm;       /* initialised stream the backend may reuse */
+    size_t size_hint;     /* expected output length, 0 if unknown */
+    int threads;          /* worker threads the backend may use, 0 = one per CPU */
+    char note[96];        /* what the backend did, for the log */
+} InflateJob;
+
+typedef struct {
+    const char* name;
+    /* decode a whole LVZ of a known container into fresh segments; 0 on success */
+    int (*decode)(InflateJob* job, LvzFormat fmt, const uint8_t* in, size_t in_len, SegBuf* out);
+} InflateBackend;
+
+/* a one-piece heap result as the only segment */
+static int adopt_heap(int rc, uint8_t* d, size_t n, SegBuf* out) {
+    Blob b = { d, n, 0 };
+    if (rc == 0) segbuf_adopt(out, &b);
+    return rc;
+}
+
+static int zlib_backend_decode(InflateJob* job, LvzFormat fmt, const uint8_t* in, size_t in_len,
+                               SegBuf* out) {
+    return try_inflate(job->strm, in, in_len, lvz_window_bits(fmt), job->size_hint, out);
+}
+
+/* the built-in decoders copy matches out of their own output, so they
+   keep one contiguous buffer */
+static int builtin_backend_decode(InflateJob* job, LvzFormat fmt, const uint8_t* in, size_t in_len,
+                                  SegBuf* out) {
+    uint8_t* d = NULL; size_t n = 0;
+    int rc = dfl_inflate_lvz(fmt, in, in_len, job->size_hint, &d, &n);
+    return adopt_heap(rc, d, n, out);
+}
+
+static int parallel_backend_decode(InflateJob* job, LvzFormat fmt, const uint8_t* in, size_t in_len,
+                                   SegBuf* out) {
+    uint8_t* d = NULL; size_t n = 0;
+    int rc = par_inflate_lvz(fmt, in, in_len, job->threads, &d, &n,
+                             job->note, sizeof(job->note));
+    if (rc > 0) rc = dfl_inflate_lvz(fmt, in, in_len, job->size_hint, &d, &n);
+    return adopt_heap(rc, d, n, out);
+}
+
+#ifdef UNIMG_HAVE_LIBDEFLATE
+/* libdeflate is one-shot only: retry with a larger buffer until it fits */
+static int libdeflate_backend_decode(InflateJob* job, LvzFormat fmt, const uint8_t* in, size_t in_len,
+                                     SegBuf* out) {
+    struct libdeflate_decompressor* dc = libdeflate_alloc_decompressor();
+    if (!dc) return -1;
+    size_t cap = job->size_hint ? job->size_hint : in_len * 4 + 1024;
+    for (;;) {
+        uint8_t* buf = (uint8_t*)big_alloc(cap);
+        size_t got = 0;
+        enum libdeflate_result r =
+            fmt == LVZ_ZLIB ? libdeflate_zlib_decompress(dc, in, in_len, buf, cap, &got) :
+            fmt == LVZ_GZIP ? libdeflate_gzip_decompress(dc, in, in_len, buf, cap, &got) :
+                              libdeflate_deflate_decompress(dc, in, in_len, buf, cap, &got);
+        if (r == LIBDEFLATE_SUCCESS) {
+            libdeflate_free_decompressor(dc);
+            return adopt_heap(0, buf, got, out);
+        }
+        big_free(buf);
+        if (r != LIBDEFLATE_INSUFFICIENT_SPACE) break;
+        cap *= 2;
+    }
+    libdeflate_free_decompressor(dc);
+    return -2;
+}
+#endif
+
+static const InflateBackend inflate_backends[] = {
+    { "zlib",       zlib_backend_decode },
+    { "builtin",    builtin_backend_decode },
+    { "parallel",   parallel_backend_decode },
+#ifdef UNIMG_HAVE_LIBDEFLATE
+    { "libdeflate", libdeflate_backend_decode },
+#endif
+    { NULL, NULL }
+};
+
+/* build-time default; override with --inflate */
+#ifndef UNIMG_DEFAULT_INFLATE
+  #define UNIMG_DEFAULT_INFLATE "zlib"
+#endif
+
+static const InflateBackend* find_inflate_backend(const char* name) {
+    for (const InflateBackend* b = inflate_backends; b->name; ++b)
+        if (strcmp(b->name, name) == 0) return b;
+    return NULL;
+}
+
+typedef struct {
+    LvzFormat fmt;
+    const char* size_src;   /* where the output allocation size came from */
+    size_t size_hint;
+    char note[96];          /* backend remark, may be empty */
+} LvzInfo;
+
+/* Detect the container and run one decoder; stored (or undecodable) input
+   is moved into out as is, leaving lvz empty. With size_prepass, zlib and
+   raw streams are decoded once without output to size the buffer exactly. */
+static void maybe_decompress_lvz(Blob* lvz, const InflateBackend* be, int size_prepass, int threads,
+                                 SegBuf* out, LvzInfo* info) {
+    const uint8_t* in = lvz->data;
+    size_t in_len = lvz->len;
+    z_stream strm; memset(&strm, 0, sizeof(strm));
+    InflateJob job; memset(&job, 0, sizeof(job));
+    LvzFormat fmt = LVZ_STORED;
+    size_t hint = 0;
+    const char* src = "input";
+
+    if (inflateInit2(&strm, -15) == Z_OK) {
+        fmt = detect_lvz_format(&strm, in, in_len);
+        int wbits = lvz_window_bits(fmt);
+        if (fmt == LVZ_GZIP) {
+            hint = gzip_isize(in, in_len);
+            src = hint ? "gzip trailer" : "estimate";
+        } else if (fmt != LVZ_STORED) {
+            src = "estimate";
+            if (size_prepass && inflate_measure(&strm, in, in_len, wbits, &hint) == 0) src = "prepass";
+            else hint = 0;
+        }
+        job.strm = &strm;
+        job.size_hint = hint;
+        job.threads = threads;
+        if (fmt != LVZ_STORED && be->decode(&job, fmt, in, in_len, out) != 0) {
+            fmt = LVZ_STORED;
+            hint = 0; src = "input";
+        }
+        inflateEnd(&strm);
+    }
+    if (info) {
+        info->fmt = fmt; info->size_src = src; info->size_hint = hint;
+        memcpy(info->note, job.note, sizeof(info->note));
+    }
+    if (fmt != LVZ_STORED) return;
+    segbuf_adopt(out, lvz);
+}
+
+/* dynamic list of headers */
+static void header_list_init(HeaderList* hl, Alloc* al) {
+    hl->items = NULL; hl->count = 0; hl->cap = 0;
+    hl->al = al;
+    hl->max = 0; hl->spilled = 0; hl->spill = NULL;
+}
+static void header_list_push(HeaderList* hl, const WrldHeader* h) {
+    if (hl->count == hl->cap) {
+        size_t cap = hl->cap ? hl->cap * 2 : 128;
+        hl->items = (WrldHeader*)hl->al->grow(hl->al, hl->items, hl->cap * sizeof(WrldHeader),
+                                              cap * sizeof(WrldHeader));
+        hl->cap = cap;
+    }
+    hl->items[hl->count++] = *h;
+}
+static void header_list_free(HeaderList* hl) {
+    hl->al->release(hl->al, hl->items);
+    if (hl->spill) fclose(hl->spill);
+    hl->items = NULL; hl->count = hl->cap = 0;
+    hl->spilled = 0; hl->spill = NULL;
+}
+
+/* move the in-memory headers to the end of the spill file */
+static void header_list_spill(HeaderList* hl) {
+    if (!hl->spill && !(hl->spill = tmpfile())) die("Cannot create a temporary file for headers");
+    if (fseek(hl->spill, 0, SEEK_END) != 0 ||
+        fwrite(hl->items, sizeof(WrldHeader), hl->count, hl->spill) != hl->count)
+        die("Cannot write the header spill file");
+    hl->spilled += hl->count;
+    hl->count = 0;
+}
+
+static size_t header_list_total(const HeaderList* hl) {
+    return hl->spilled + hl->count;
+}
+
+/* headers in order, spilled ones first; *i starts at 0. Returns 0 at the end. */
+static int header_list_next(HeaderList* hl, size_t* i, WrldHeader* h) {
+    if (*i < hl->spilled) {
+        if (*i == 0 && fseek(hl->spill, 0, SEEK_SET) != 0) die("Cannot read the header spill file");
+        if (fread(h, sizeof(WrldHeader), 1, hl->spill) != 1) die("Cannot read the header spill file");
+    } else if (*i - hl->spilled < hl->count) {
+        *h = hl->items[*i - hl->spilled];
+    } else {
+        return 0;
+    }
+    ++*i;
+    return 1;
+}
+static int cmp_by_lvz_off(const void* a, const void* b) {
+    const WrldHeader* x = (const WrldHeader*)a;
+    const WrldHeader* y = (const WrldHeader*)b;
+    if (x->lvz_off < y->lvz_off) return -1;
+    if (x->lvz_off > y->lvz_off) return 1;
+    return 0;
+}
+
+/* DLRW search kernels: return the first j >= from with "DLRW" at d+j, or n */
+typedef size_t (*find_dlrw_fn)(const uint8_t* d, size_t from, size_t n);
+
+static size_t find_dlrw_scalar(const uint8_t* d, size_t j, size_t n) {
+    for (; j + 4 <= n; ++j) {
+        if (d[j]=='D' && d[j+1]=='L' && d[j+2]=='R' && d[j+3]=='W') return j;
+    }
+    return n;
+}
+
+#ifdef UNIMG_X86
+/* compare the four signature bytes at shifted loads, 16 positions per step */
+TARGET_SSE2 static size_t find_dlrw_sse2(const uint8_t* d, size_t j, size_t n) {
+    const __m128i cD = _mm_set1_epi8('D'), cL = _mm_set1_epi8('L');
+    const __m128i cR = _mm_set1_epi8('R'), cW = _mm_set1_epi8('W');
+    for (; j + 16 + 3 <= n; j += 16) {
+        __m128i m = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(d + j)), cD);
+        m = _mm_and_si128(m, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(d + j + 1)), cL));
+        m = _mm_and_si128(m, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(d + j + 2)), cR));
+        m = _mm_and_si128(m, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(d + j + 3)), cW));
+        uint32_t bits = (uint32_t)_mm_movemask_epi8(m);
+        if (bits) return j + (size_t)ctz32(bits);
+    }
+    return find_dlrw_scalar(d, j, n);
+}
+
+/* same as sse2 with 32 positions per step */
+TARGET_AVX2 static size_t find_dlrw_avx2(const uint8_t* d, size_t j, size_t n) {
+    const __m256i cD = _mm256_set1_epi8('D'), cL = _mm256_set1_epi8('L');
+    const __m256i cR = _mm256_set1_epi8('R'), cW = _mm256_set1_epi8('W');
+    for (; j + 32 + 3 <= n; j += 32) {
+        __m256i m = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(d + j)), cD);
+        m = _mm256_and_si256(m, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(d + j + 1)), cL));
+        m = _mm256_and_si256(m, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(d + j + 2)), cR));
+        m = _mm256_and_si256(m, _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(d + j + 3)), cW));
+        uint32_t bits = (uint32_t)_mm256_movemask_epi8(m);
+        if (bits) return j + (size_t)ctz32(bits);
+    }
+    return find_dlrw_sse2(d, j, n);
+}
+
+static int cpu_has_sse2(void) {
+#ifdef _MSC_VER
+    int r[4]; __cpuid(r, 1);
+    return (r[3] >> 26) & 1;
+#else
+    return __builtin_cpu_supports("sse2");
+#endif
+}
+
+static int cpu_has_avx2(void) {
+#ifdef _MSC_VER
+    int r[4]; __cpuid(r, 0);
+    if (r[0] < 7) return 0;
+    __cpuid(r, 1);
+    if (!((r[2] >> 27) & 1)) return 0;           /* OSXSAVE */
+    if ((_xgetbv(0) & 6) != 6) return 0;         /* XMM+YMM state enabled */
+    __cpuidex(r, 7, 0);
+    return (r[1] >> 5) & 1;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+typedef struct {
+    const char* name;
+    find_dlrw_fn fn;
+} ScanKernel;
+
+/* available kernels, best first; NULL-terminated */
+static const ScanKernel* scan_kernels(void) {
+    static ScanKernel ks[4];
+    static int init = 0;
+    if (!init) {
+        int k = 0;
+#ifdef UNIMG_X86
+        if (cpu_has_avx2()) { ks[k].name = "avx2"; ks[k].fn = find_dlrw_avx2; ++k; }
+        if (cpu_has_sse2()) { ks[k].name = "sse2"; ks[k].fn = find_dlrw_sse2; ++k; }
+#endif
+        ks[k].name = "scalar"; ks[k].fn = find_dlrw_scalar; ++k;
+        ks[k].name = NULL; ks[k].fn = NULL;
+        init = 1;
+    }
+    return ks;
+}
+
+/* headers whose signature starts in [from, to); d is readable up to lim
+   and d[0] sits at stream offset base */
+static void scan_range(const uint8_t* d, size_t from, size_t to, size_t lim,
+                       find_dlrw_fn find, u64 base, HeaderList* out) {
+    /* a header starting before `to` ends at most 31 bytes past it */
+    size_t n = (to + 31 < lim) ? to + 31 : lim;
+    size_t i = from;
+    while (1) {
+        size_t j = find(d, i, n);
+        if (j + 32 > n) break;
+
+        uint32_t wrld_type = read_u32le(d, j+0x04);
+        uint32_t total     = read_u32le(d, j+0x08);
+        uint32_t g0        = read_u32le(d, j+0x0C);
+        uint32_t g1        = read_u32le(d, j+0x10);
+        uint32_t gcnt      = read_u32le(d, j+0x14);
+        uint32_t cont      = read_u32le(d, j+0x18);
         uint32_t resv      = read_u32le(d, j+0x1C);
 
-        if (total >= 32 && cont != 0) {
-            WrldHeader h = { (uint32_t)j, wrld_type, total, g0, g1, gcnt, cont, resv };
-            header_list_push(out, h);
-            if (log && hits < 50) {
-                fprintf(log, "[scan] [%zu] @LVZ+0x%08X type=%u size=%u g0=0x%X g1=0x%X gcnt=%u cont=0x%X\n",
-                        out->count-1, (unsigned)h.lvz_off, h.wrld_type, h.total_size,
-                        h.global0, h.global1, h.global_count, h.continuation);
+        if (total >= 32 && cont != 0) {
+            WrldHeader h = { (uint32_t)(base + j), wrld_type, total, g0, g1, gcnt, cont, resv, {0} };
+            memcpy(h.raw, d + j, 32);
+            header_list_push(out, &h);
+        }
+        i = j + 4;
+    }
+}
+
+/* scan_range over [from, to) of a segmented buffer; a header that runs
+   across a segment boundary is read through a small stitch buffer */
+static void scan_segs(const SegBuf* sb, size_t from, size_t to, find_dlrw_fn find, HeaderList* out) {
+    size_t base = 0;
+    for (size_t k = 0; k < sb->nseg && base < to; base += sb->seg[k++].len) {
+        const Seg* g = &sb->seg[k];
+        size_t lo = from > base ? from : base;
+        size_t hi = to < base + g->len ? to : base + g->len;
+        if (lo >= hi) continue;
+        scan_range(g->p, lo - base, hi - base, g->len, find, base, out);
+        /* starts in the last 31 bytes, completed by the next segment */
+        size_t tail = g->len > 31 ? base + g->len - 31 : base;
+        if (tail < lo) tail = lo;
+        if (k + 1 < sb->nseg && tail < hi) {
+            uint8_t tmp[62];
+            size_t m = segbuf_read(sb, tail, tmp, hi - tail + 31);
+            scan_range(tmp, 0, hi - tail, m, find, tail, out);
+        }
+    }
+}
+
+typedef struct {
+    const SegBuf* sb;
+    size_t from, to;
+    find_dlrw_fn find;
+    HeaderList found;
+} ScanPart;
+
+static void* scan_part_main(void* arg) {
+    ScanPart* p = (ScanPart*)arg;
+    scan_segs(p->sb, p->from, p->to, p->find, &p->found);
+    return NULL;
+}
+
+/* threads: 0 = one per CPU, capped so every part gets at least SCAN_MIN_PART bytes */
+#define SCAN_MIN_PART (4u << 20)
+
+/* out must be initialised and empty. The part tables come from out's
+   allocator; the parts collect on the system allocator, since they grow
+   side by side and are freed once copied into out. */
+static void scan_slave_headers(const SegBuf* sb, int threads, HeaderList* out, FILE* log) {
+    const ScanKernel* kern = &scan_kernels()[0];
+    size_t n = sb->len;
+
+    size_t parts = threads > 0 ? (size_t)threads : (size_t)cpu_count();
+    if (threads <= 0 && parts > n / SCAN_MIN_PART) parts = n / SCAN_MIN_PART;
+    if (parts > n / 64) parts = n / 64;
+    if (parts < 1) parts = 1;
+    if (log) fprintf(log, "[scan] kernel: %s, threads: %zu\n", kern->name, parts);
+
+    if (parts == 1) {
+        scan_segs(sb, 0, n, kern->fn, out);
+    } else {
+        Alloc* al = out->al;
+        ScanPart* ps = (ScanPart*)al->alloc(al, parts * sizeof(ScanPart));
+        thread_t* tids = (thread_t*)al->alloc(al, parts * sizeof(thread_t));
+        int* started = (int*)al->alloc(al, parts * sizeof(int));
+        size_t step = n / parts;
+        for (size_t k = 0; k < parts; ++k) {
+            ps[k].sb = sb; ps[k].find = kern->fn;
+            ps[k].from = k * step;
+            ps[k].to = (k + 1 == parts) ? n : (k + 1) * step;
+            header_list_init(&ps[k].found, &sys_alloc);
+            started[k] = (k > 0) && thread_start(&tids[k], scan_part_main, &ps[k]) == 0;
+        }
+        scan_part_main(&ps[0]);
+        for (size_t k = 1; k < parts; ++k) {
+            if (started[k]) thread_join(tids[k]);
+            else scan_part_main(&ps[k]);
+        }
+
+        /* parts are disjoint and ascending: concatenate */
+        size_t total = 0;
+        for (size_t k = 0; k < parts; ++k) total += ps[k].found.count;
+        out->cap = total ? total : 1;
+        out->items = (WrldHeader*)out->al->alloc(out->al, out->cap * sizeof(WrldHeader));
+        for (size_t k = 0; k < parts; ++k) {
+            if (ps[k].found.count)
+                memcpy(out->items + out->count, ps[k].found.items,
+                       ps[k].found.count * sizeof(WrldHeader));
+            out->count += ps[k].found.count;
+            header_list_free(&ps[k].found);
+        }
+        al->release(al, started); al->release(al, tids); al->release(al, ps);
+    }
+
+    if (log) {
+        for (size_t k = 0; k < out->count && k < 50; ++k) {
+            const WrldHeader* h = &out->items[k];
+            fprintf(log, "[scan] [%zu] @LVZ+0x%08X type=%u size=%u g0=0x%X g1=0x%X gcnt=%u cont=0x%X\n",
+                    k, (unsigned)h->lvz_off, h->wrld_type, h->total_size,
+                    h->global0, h->global1, h->global_count, h->continuation);
+        }
+    }
+
+    /* sort and dedupe by lvz_off */
+    qsort(out->items, out->count, sizeof(WrldHeader), cmp_by_lvz_off);
+    size_t w = 0;
+    for (size_t r = 0; r < out->count; ++r) {
+        if (w == 0 || out->items[r].lvz_off != out->items[w-1].lvz_off) {
+            out->items[w++] = out->items[r];
+        }
+    }
+    out->count = w;
+
+    if (log) fprintf(log, "[scan] total slave headers: %zu\n", out->count);
+}
+
+/* incremental scanner for a stream delivered in chunks; the last 31 bytes
+   seen cannot hold a complete header yet and are carried into the next feed */
+typedef struct {
+    find_dlrw_fn find;
+    uint8_t carry[31];
+    size_t carry_len;
+    u64 pos;            /* stream offset of carry[0] */
+    uint8_t head[4];    /* first bytes of the stream, for the DLRW check */
+    size_t head_len;
+    HeaderList* out;
+} StreamScan;
+
+static void stream_scan_init(StreamScan* ss, HeaderList* out) {
+    memset(ss, 0, sizeof(*ss));
+    ss->find = scan_kernels()[0].fn;
+    ss->out = out;
+}
+
+static void stream_scan_feed(StreamScan* ss, const uint8_t* c, size_t len) {
+    size_t p = ss->carry_len;
+    while (ss->head_len < 4 && ss->head_len < p + len) {
+        size_t k = ss->head_len;
+        ss->head[ss->head_len++] = (k < p) ? ss->carry[k] : c[k - p];
+    }
+
+    /* signatures starting in the carry, completed by the chunk's first bytes */
+    if (p) {
+        uint8_t tmp[62];
+        size_t q = len < 31 ? len : 31;
+        memcpy(tmp, ss->carry, p);
+        memcpy(tmp + p, c, q);
+        scan_range(tmp, 0, p, p + q, ss->find, ss->pos, ss->out);
+    }
+    scan_range(c, 0, len, len, ss->find, ss->pos + p, ss->out);
+
+    /* carry the tail that was not examined: the last min(31, p+len) bytes */
+    size_t keep = (p + len < 31) ? p + len : 31;
+    size_t from_chunk = keep < len ? keep : len;
+    size_t from_carry = keep - from_chunk;
+    uint8_t nb[31];
+    memcpy(nb, ss->carry + p - from_carry, from_carry);
+    memcpy(nb + from_carry, c + len - from_chunk, from_chunk);
+    memcpy(ss->carry, nb, keep);
+    ss->pos += p + len - keep;
+    ss->carry_len = keep;
+}
+
+#define STREAM_IN_CHUNK  (256u << 10)
+#define STREAM_OUT_CHUNK (1u << 20)
+
+static size_t header_list_max;   /* --mem-budget: streamed headers kept in memory */
+
+#define MEM_BUDGET_MIN 16u          /* MiB */
+#define MEM_PER_HEADER 256u         /* plan, pool state and a buffered log line */
+
+typedef void (*header_fn)(const WrldHeader* h, size_t idx, void* ctx);
+
+/* ---- random-access index (zran-style) ----
+   An access point is a deflate block boundary: the LVZ byte and bit where
+   the block starts plus the 32 KiB of output before it, which is all
+   inflate needs to resume there. Points are taken every span bytes of
+   output while the stream is scanned, so any offset can be reached by
+   decoding at most span bytes. Each point also records how many slave
+   headers precede it, so a header found after a point gets the same
+   wrld_NNNN number as in a full run. Stored LVZ files get points too
+   (without windows) for the header counts. */
+
+#define ZIDX_MAGIC        "UZIX"
+#define ZIDX_VERSION      1u
+#define ZIDX_HDR_SIZE     56
+#define ZIDX_POINT_SIZE   32
+#define ZIDX_DEFAULT_SPAN (4u << 20)
+
+typedef struct {
+    u64 out;              /* decompressed offset */
+    u64 in;               /* LVZ offset of the first whole byte of the block */
+    uint32_t bits;        /* bits of in[-1] that belong to the block (0..7) */
+    uint32_t hdr_before;  /* slave headers with lvz_off < out */
+    uint32_t win_len;     /* DFL_WSIZE, or less near the start */
+    uint8_t* win;
+} ZPoint;
+
+typedef struct {
+    LvzFormat fmt;
+    u64 span;
+    u64 lvz_size, lvz_mtime;  /* the LVZ the index was built from */
+    u64 decomp_len;
+    ZPoint* pts;
+    size_t count, cap;
+    size_t pending;           /* first point whose hdr_before is not known yet */
+    Alloc* al;                /* points and windows */
+} ZIndex;
+
+static void zidx_init(ZIndex* zi, u64 span, Alloc* al) {
+    memset(zi, 0, sizeof(*zi));
+    zi->span = span ? span : ZIDX_DEFAULT_SPAN;
+    zi->al = al;
+}
+
+static void zidx_free(ZIndex* zi) {
+    for (size_t i = 0; i < zi->count; ++i) zi->al->release(zi->al, zi->pts[i].win);
+    zi->al->release(zi->al, zi->pts);
+    zi->pts = NULL; zi->count = zi->cap = zi->pending = 0;
+}
+
+static void zidx_add_point(ZIndex* zi, u64 out, u64 in, unsigned bits,
+                           const uint8_t* win, size_t win_len) {
+    if (zi->count == zi->cap) {
+        size_t old = zi->cap * sizeof(ZPoint);
+        zi->cap = zi->cap ? zi->cap * 2 : 64;
+        zi->pts = (ZPoint*)zi->al->grow(zi->al, zi->pts, old, zi->cap * sizeof(ZPoint));
+    }
+    ZPoint* p = &zi->pts[zi->count++];
+    p->out = out; p->in = in; p->bits = bits;
+    p->hdr_before = 0;
+    p->win_len = (uint32_t)win_len;
+    p->win = NULL;
+    if (win_len) {
+        p->win = (uint8_t*)zi->al->alloc(zi->al, win_len);
+        memcpy(p->win, win, win_len);
+    }
+}
+
+/* is a new point due at output offset out? */
+static int zidx_due(const ZIndex* zi, u64 out) {
+    return zi->count == 0 || out - zi->pts[zi->count - 1].out >= zi->span;
+}
+
+/* header idx at LVZ offset off was found; points at or before it now know
+   how many headers precede them */
+static void zidx_note_header(ZIndex* zi, size_t idx, u64 off) {
+    while (zi->pending < zi->count && zi->pts[zi->pending].out <= off)
+        zi->pts[zi->pending++].hdr_before = (uint32_t)idx;
+}
+
+/* points past the last header come after all of them */
+static void zidx_finish(ZIndex* zi, size_t headers, u64 decomp_len) {
+    zi->decomp_len = decomp_len;
+    for (; zi->pending < zi->count; ++zi->pending) zi->pts[zi->pending].hdr_before = (uint32_t)headers;
+}
+
+/* hand new headers to on_header, then spill the list if it is over its
+   limit; emitted counts every header handed out so far */
+static void stream_emit(HeaderList* out, size_t* emitted, header_fn on_header, void* ctx, ZIndex* zi) {
+    for (; *emitted < header_list_total(out); ++*emitted) {
+        const WrldHeader* h = &out->items[*emitted - out->spilled];
+        if (zi) zidx_note_header(zi, *emitted, h->lvz_off);
+        on_header(h, *emitted, ctx);
+    }
+    if (out->max && out->count >= out->max) header_list_spill(out);
+}
+
+/* inflate the LVZ in fixed-size chunks and scan the output as it arrives;
+   only header copies are kept. Each accepted header is handed to on_header
+   in stream order as soon as it is found. With zi, access points are
+   recorded along the way. out must be initialised. Returns 0, or -1 if
+   the stream broke off (headers found up to that point are kept). */
+static int stream_scan_lvz(const char* lvz_path, HeaderList* out,
+                           header_fn on_header, void* ctx, ZIndex* zi, LvzFormat* fmt_out,
+                           u64* lvz_len, u64* decomp_len, int* starts_dlrw, FILE* log) {
+    FILE* f = fopen(lvz_path, "rb");
+    if (!f) die("Cannot open LVZ: %s", lvz_path);
+    uint8_t* in = (uint8_t*)xmalloc(STREAM_IN_CHUNK);
+    /* output lands after the last DFL_WSIZE bytes, which stay in front as
+       the window for access points */
+    uint8_t* obuf = (uint8_t*)xmalloc(DFL_WSIZE + STREAM_OUT_CHUNK);
+    size_t ohave = 0;
+    size_t in_len = fread(in, 1, STREAM_IN_CHUNK, f);
+    u64 in_total = in_len, total = 0;
+    int rc = 0;
+
+    StreamScan ss; stream_scan_init(&ss, out);
+    out->max = header_list_max;
+    size_t emitted = 0;
+    z_stream strm; memset(&strm, 0, sizeof(strm));
+    if (inflateInit2(&strm, -15) != Z_OK) die("inflateInit2 failed");
+    LvzFormat fmt = detect_lvz_format(&strm, in, in_len);
+    if (log) fprintf(log, "[io] LVZ format: %s\n", lvz_format_name(fmt));
+    if (zi) zi->fmt = fmt;
+    if (fmt_out) *fmt_out = fmt;
+
+    if (fmt == LVZ_STORED) {
+        while (in_len) {
+            if (zi && zidx_due(zi, total)) zidx_add_point(zi, total, total, 0, NULL, 0);
+            stream_scan_feed(&ss, in, in_len);
+            total += in_len;
+            stream_emit(out, &emitted, on_header, ctx, zi);
+            in_len = fread(in, 1, STREAM_IN_CHUNK, f);
+            in_total += in_len;
+        }
+    } else {
+        if (inflateReset2(&strm, lvz_window_bits(fmt)) != Z_OK) die("inflateReset2 failed");
+        strm.next_in = in;
+        strm.avail_in = (unsigned)in_len;
+        /* raw deflate has no header for Z_BLOCK to stop after, so the
+           first point is placed from the parsed container header */
+        size_t hdr = 0;
+        if (zi && lvz_deflate_start(fmt, in, in_len, &hdr) == 0) zidx_add_point(zi, 0, hdr, 0, NULL, 0);
+        for (;;) {
+            if (ohave == DFL_WSIZE + STREAM_OUT_CHUNK) {
+                memmove(obuf, obuf + STREAM_OUT_CHUNK, DFL_WSIZE);
+                ohave = DFL_WSIZE;
+            }
+            strm.next_out = obuf + ohave;
+            strm.avail_out = (unsigned)(DFL_WSIZE + STREAM_OUT_CHUNK - ohave);
+            /* Z_BLOCK stops at block boundaries, where access points can go */
+            int ret = inflate(&strm, zi ? Z_BLOCK : Z_NO_FLUSH);
+            size_t got = (size_t)(strm.next_out - (obuf + ohave));
+            if (got) {
+                stream_scan_feed(&ss, obuf + ohave, got);
+                ohave += got;
+                total += got;
+                stream_emit(out, &emitted, on_header, ctx, zi);
+            }
+            if (zi && (strm.data_type & 128) && !(strm.data_type & 64) && zidx_due(zi, total)) {
+                size_t w = ohave < DFL_WSIZE ? ohave : DFL_WSIZE;
+                zidx_add_point(zi, total, in_total - strm.avail_in, (unsigned)(strm.data_type & 7),
+                               obuf + ohave - w, w);
+            }
+            if (ret == Z_STREAM_END) break;
+            if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                if (log) fprintf(log, "[stream] inflate error %d after %llu input bytes\n",
+                                 ret, (unsigned long long)(in_total - strm.avail_in));
+                rc = -1;
+                break;
+            }
+            if (strm.avail_in == 0) {
+                in_len = fread(in, 1, STREAM_IN_CHUNK, f);
+                if (in_len == 0 && got == 0) {
+                    if (log) fprintf(log, "[stream] deflate stream truncated\n");
+                    rc = -1;
+                    break;
+                }
+                in_total += in_len;
+                strm.next_in = in;
+                strm.avail_in = (unsigned)in_len;
+            }
+        }
+    }
+    inflateEnd(&strm);
+    fclose(f);
+    free(in); free(obuf);
+
+    if (zi) zidx_finish(zi, emitted, total);
+    *lvz_len = in_total;
+    *decomp_len = total;
+    *starts_dlrw = ss.head_len == 4 && memcmp(ss.head, "DLRW", 4) == 0;
+    return rc;
+}
+
+/* <out_dir>/<stem>.zidx: a fixed header, then each point followed by its
+   window. All fields little-endian. */
+static int zidx_save(const ZIndex* zi, const char* path) {
+    FILE* f = fopen(path, "wb");
+    if (!f) return -1;
+    uint8_t h[ZIDX_HDR_SIZE]; memset(h, 0, sizeof(h));
+    memcpy(h, ZIDX_MAGIC, 4);
+    put_u32le(h, 4, ZIDX_VERSION);
+    put_u32le(h, 8, (uint32_t)zi->fmt);
+    put_u64le(h, 16, zi->span);
+    put_u64le(h, 24, zi->lvz_size);
+    put_u64le(h, 32, zi->lvz_mtime);
+    put_u64le(h, 40, zi->decomp_len);
+    put_u64le(h, 48, zi->count);
+    int ok = fwrite(h, 1, sizeof(h), f) == sizeof(h);
+    for (size_t i = 0; ok && i < zi->count; ++i) {
+        const ZPoint* p = &zi->pts[i];
+        uint8_t r[ZIDX_POINT_SIZE]; memset(r, 0, sizeof(r));
+        put_u64le(r, 0, p->out);
+        put_u64le(r, 8, p->in);
+        put_u32le(r, 16, p->bits);
+        put_u32le(r, 20, p->hdr_before);
+        put_u32le(r, 24, p->win_len);
+        ok = fwrite(r, 1, sizeof(r), f) == sizeof(r)
+          && (p->win_len == 0 || fwrite(p->win, 1, p->win_len, f) == p->win_len);
+    }
+    if (fclose(f) != 0) ok = 0;
+    if (!ok) { remove(path); return -1; }
+    return 0;
+}
+
+/* 0 if path holds an index built from an LVZ of this size and mtime;
+   zi must be initialised, for its allocator */
+static int zidx_load(ZIndex* zi, const char* path, u64 lvz_size, u64 lvz_mtime) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return -1;
+    uint8_t h[ZIDX_HDR_SIZE];
+    int ok = fread(h, 1, sizeof(h), f) == sizeof(h)
+          && memcmp(h, ZIDX_MAGIC, 4) == 0
+          && read_u32le(h, 4) == ZIDX_VERSION
+          && read_u32le(h, 8) <= LVZ_RAW
+          && read_u64le(h, 24) == lvz_size
+          && read_u64le(h, 32) == lvz_mtime;
+    if (ok) {
+        zidx_init(zi, read_u64le(h, 16), zi->al);
+        zi->fmt = (LvzFormat)read_u32le(h, 8);
+        zi->lvz_size = lvz_size;
+        zi->lvz_mtime = lvz_mtime;
+        zi->decomp_len = read_u64le(h, 40);
+        u64 n = read_u64le(h, 48);
+        for (u64 i = 0; ok && i < n; ++i) {
+            uint8_t r[ZIDX_POINT_SIZE];
+            ok = fread(r, 1, sizeof(r), f) == sizeof(r);
+            uint32_t wl = ok ? read_u32le(r, 24) : 0;
+            uint32_t bits = ok ? read_u32le(r, 16) : 0;
+            if (!ok || wl > DFL_WSIZE || bits > 7) { ok = 0; break; }
+            uint8_t win[DFL_WSIZE];
+            if (fread(win, 1, wl, f) != wl) { ok = 0; break; }
+            zidx_add_point(zi, read_u64le(r, 0), read_u64le(r, 8), bits, win, wl);
+            zi->pts[zi->count - 1].hdr_before = read_u32le(r, 20);
+        }
+        if (ok && zi->count == 0) ok = 0;
+        if (!ok) zidx_free(zi);
+    }
+    fclose(f);
+    return ok ? 0 : -1;
+}
+
+/* last point at or before decompressed offset off, or NULL */
+static const ZPoint* zidx_point_for(const ZIndex* zi, u64 off) {
+    if (zi->pts[0].out > off) return NULL;
+    size_t lo = 0, hi = zi->count;
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (zi->pts[mid].out <= off) lo = mid; else hi = mid;
+    }
+    return &zi->pts[lo];
+}
+
+/* decode up to len bytes of output starting at point p into dst;
+   returns the byte count, or -1 if the LVZ cannot be read from there */
+static long long zidx_read(const ZIndex* zi, const ZPoint* p, FILE* f, uint8_t* dst, size_t len) {
+    if (fseek64(f, (long long)(p->in - (p->bits ? 1 : 0)), SEEK_SET) != 0) return -1;
+    if (zi->fmt == LVZ_STORED) return (long long)fread(dst, 1, len, f);
+
+    z_stream strm; memset(&strm, 0, sizeof(strm));
+    if (inflateInit2(&strm, -15) != Z_OK) return -1;
+    int rc = Z_OK;
+    if (p->bits) {
+        int c = getc(f);
+        rc = c == EOF ? Z_DATA_ERROR : inflatePrime(&strm, (int)p->bits, c >> (8 - p->bits));
+    }
+    if (rc == Z_OK && p->win_len) rc = inflateSetDictionary(&strm, p->win, p->win_len);
+
+    uint8_t* in = (uint8_t*)xmalloc(STREAM_IN_CHUNK);
+    strm.next_out = dst;
+    strm.avail_out = (unsigned)len;
+    while (rc == Z_OK && strm.avail_out) {
+        if (strm.avail_in == 0) {
+            size_t got = fread(in, 1, STREAM_IN_CHUNK, f);
+            if (got == 0) break;
+            strm.next_in = in;
+            strm.avail_in = (unsigned)got;
+        }
+        rc = inflate(&strm, Z_NO_FLUSH);
+    }
+    long long produced = (long long)(len - strm.avail_out);
+    free(in);
+    inflateEnd(&strm);
+    return (rc == Z_OK || rc == Z_STREAM_END) ? produced : -1;
+}
+
+/* ---- IMG access ----
+   The IMG is opened once. With IMG_IO_MMAP it is mapped read-only and
+   bodies are written straight from the mapping; IMG_IO_STDIO seeks and
+   copies through one reusable buffer, and is also what mmap falls back to
+   when the file cannot be mapped (e.g. a 32-bit build and a large IMG).
+   IMG_IO_KERNEL (Linux) has the kernel move bodies file to file with
+   copy_file_range, or sendfile where that is refused (older kernels,
+   cross-filesystem), and finishes with the stdio loop if both are. On a
+   reflink filesystem (btrfs, XFS) holding both the IMG and the output,
+   it first clones the block-aligned middle of each body with
+   FICLONERANGE. IMG_IO_URING (Linux) extracts through io_uring with many
+   bodies in flight; single WRLDs written outside that engine (--stream,
+   --at) take the kernel path. IMG_IO_DIRECT (Linux) reads the IMG and
+   writes the WRLDs with O_DIRECT, so a bulk extraction does not push
+   other processes' data out of the page cache. */
+
+typedef enum { IMG_IO_STDIO = 0, IMG_IO_MMAP, IMG_IO_KERNEL, IMG_IO_URING, IMG_IO_DIRECT } ImgIoMode;
+
+#ifdef __linux__
+  #define IMG_IO_DEFAULT IMG_IO_KERNEL
+#else
+  #define IMG_IO_DEFAULT IMG_IO_MMAP
+#endif
+
+static const char* img_io_name(ImgIoMode m) {
+    return m == IMG_IO_MMAP ? "mmap" : m == IMG_IO_KERNEL ? "kernel"
+         : m == IMG_IO_URING ? "uring" : m == IMG_IO_DIRECT ? "direct" : "stdio";
+}
+
+/* ---- copy buffers ----
+   User-space body copies go through chunk-sized buffers from one
+   process-wide pool, aligned for direct I/O and reused across WRLDs and
+   workers. --chunk-size sets the size before the first one is taken.
+   With huge pages on, buffers are cut from 2 MiB-aligned slabs, which
+   keeps the BUF_ALIGN alignment direct I/O needs. */
+
+#define IMG_COPY_CHUNK (1u << 20)   /* default chunk size */
+#define BUF_ALIGN      4096u
+
+static struct {
+    mutex_t mu;
+    size_t size;
+    uint8_t** free;
+    size_t nfree, cap;
+    size_t created;
+    uint8_t* slab;            /* rest of the current slab */
+    size_t slab_left;
+} buf_pool;
+
+static void buf_pool_init(size_t size) {
+    mutex_init(&buf_pool.mu);
+    buf_pool.size = size;
+}
+
+static uint8_t* buf_get(void) {
+    mutex_lock(&buf_pool.mu);
+    uint8_t* b = buf_pool.nfree ? buf_pool.free[--buf_pool.nfree] : NULL;
+    if (!b) ++buf_pool.created;
+    if (!b && huge.mode != HUGE_OFF) {
+        /* pool buffers are never freed, so slabs are never unmapped */
+        if (buf_pool.slab_left < buf_pool.size) {
+            size_t len = buf_pool.size > HUGE_PAGE ? buf_pool.size : HUGE_PAGE;
+            buf_pool.slab = (uint8_t*)big_alloc(len);
+            buf_pool.slab_left = len;
+        }
+        b = buf_pool.slab;
+        buf_pool.slab += buf_pool.size;
+        buf_pool.slab_left -= buf_pool.size;
+    }
+    mutex_unlock(&buf_pool.mu);
+    if (b) return b;
+#ifdef _WIN32
+    b = (uint8_t*)_aligned_malloc(buf_pool.size, BUF_ALIGN);
+#else
+    void* p = NULL;
+    b = posix_memalign(&p, BUF_ALIGN, buf_pool.size) == 0 ? (uint8_t*)p : NULL;
+#endif
+    if (!b) die("Out of memory (alloc %zu)", buf_pool.size);
+    return b;
+}
+
+static void buf_put(uint8_t* b) {
+    if (!b) return;
+    mutex_lock(&buf_pool.mu);
+    if (buf_pool.nfree == buf_pool.cap) {
+        buf_pool.cap = buf_pool.cap ? buf_pool.cap * 2 : 8;
+        buf_pool.free = (uint8_t**)xrealloc(buf_pool.free, buf_pool.cap * sizeof(uint8_t*));
+    }
+    buf_pool.free[buf_pool.nfree++] = b;
+    mutex_unlock(&buf_pool.mu);
+}
+
+/* double-buffered reads: a helper thread reads the next chunk of a body
+   while the caller writes out the current one */
+typedef struct {
+    FILE* f;
+    uint8_t* buf[2];
+    thread_t tid;
+    mutex_t mu;
+    cond_t cv;
+    int busy, quit;     /* a read is queued or running; helper should exit */
+    int slot;
+    u64 off;
+    size_t want, got;
+} ReadAhead;
+
+static void* read_ahead_main(void* arg) {
+    ReadAhead* r = (ReadAhead*)arg;
+    mutex_lock(&r->mu);
+    for (;;) {
+        while (!r->busy && !r->quit) cond_wait(&r->cv, &r->mu);
+        if (r->quit) break;
+        uint8_t* dst = r->buf[r->slot];
+        u64 off = r->off;
+        size_t want = r->want;
+        mutex_unlock(&r->mu);
+        size_t got = pread_full(r->f, dst, want, off);
+        mutex_lock(&r->mu);
+        r->got = got;
+        r->busy = 0;
+        cond_signal(&r->cv);
+    }
+    mutex_unlock(&r->mu);
+    return NULL;
+}
+
+/* NULL if no thread could be started; the caller then reads inline */
+static ReadAhead* read_ahead_start(FILE* f, uint8_t* buf) {
+    ReadAhead* r = (ReadAhead*)xmalloc(sizeof(ReadAhead));
+    memset(r, 0, sizeof(*r));
+    r->f = f;
+    r->buf[0] = buf;
+    r->buf[1] = buf_get();
+    mutex_init(&r->mu);
+    cond_init(&r->cv);
+    if (thread_start(&r->tid, read_ahead_main, r) != 0) {
+        cond_destroy(&r->cv); mutex_destroy(&r->mu);
+        buf_put(r->buf[1]); free(r);
+        return NULL;
+    }
+    return r;
+}
+
+static void read_ahead_stop(ReadAhead* r) {
+    if (!r) return;
+    mutex_lock(&r->mu);
+    r->quit = 1;
+    cond_signal(&r->cv);
+    mutex_unlock(&r->mu);
+    thread_join(r->tid);
+    cond_destroy(&r->cv); mutex_destroy(&r->mu);
+    buf_put(r->buf[1]);
+    free(r);
+}
+
+static void read_ahead_post(ReadAhead* r, int slot, u64 off, size_t want) {
+    mutex_lock(&r->mu);
+    r->slot = slot; r->off = off; r->want = want;
+    r->busy = 1;
+    cond_signal(&r->cv);
+    mutex_unlock(&r->mu);
+}
+
+static size_t read_ahead_wait(ReadAhead* r) {
+    mutex_lock(&r->mu);
+    while (r->busy) cond_wait(&r->cv, &r->mu);
+    size_t got = r->got;
+    mutex_unlock(&r->mu);
+    return got;
+}
+
+typedef struct {
+    ImgIoMode mode;
+    u64 size;
+    FILE* f;               /* stdio and kernel */
+    uint8_t* buf;          /* copy buffer from buf_pool */
+    ReadAhead* ra;         /* started by the first multi-chunk copy */
+    int no_ra;
+    const uint8_t* map;    /* mmap */
+    int no_cfr, no_sendfile, no_clone;
+    int no_direct_out;                     /* output filesystem refused O_DIRECT */
+    u64 via_cfr, via_sendfile, via_copy;   /* body bytes moved by each path */
+    u64 via_uring, via_direct;
+    u64 willneed, dontneed;                /* IMG bytes hinted in and out of the page cache */
+    u64 dropped_out;                       /* WRLDs dropped from the page cache */
+    u64 read_ahead;                        /* chunks read while the previous was written */
+    u64 blksize;                           /* clone granularity */
+    u64 cloned, cloned_bytes, clone_unaligned;
+#ifndef _WIN32
+    dev_t dev;
+#endif
+} ImgSource;
+
+static const uint8_t* img_map(const char* path, u64 size) {
+    if (size == 0 || size > (u64)(size_t)-1) return NULL;
+#ifdef _WIN32
+    HANDLE fh = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, NULL);
+    if (fh == INVALID_HANDLE_VALUE) return NULL;
+    HANDLE mh = CreateFileMappingA(fh, NULL, PAGE_READONLY, 0, 0, NULL);
+    void* p = mh ? MapViewOfFile(mh, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (mh) CloseHandle(mh);
+    CloseHandle(fh);
+    return (const uint8_t*)p;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    void* p = mmap(NULL, (size_t)size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return NULL;
+    /* each body is read front to back, once */
+    madvise(p, (size_t)size, MADV_SEQUENTIAL);
+    return (const uint8_t*)p;
+#endif
+}
+
+static int img_open(ImgSource* s, const char* path, ImgIoMode want) {
+    memset(s, 0, sizeof(*s));
+    s->f = fopen(path, "rb");
+    if (!s->f) return -1;
+    fseek64(s->f, 0, SEEK_END);
+    s->size = (u64)ftell64(s->f);
+    fseek64(s->f, 0, SEEK_SET);
+#ifdef __linux__
+    if (want == IMG_IO_DIRECT) {
+        int fd = open(path, O_RDONLY | O_DIRECT | O_CLOEXEC);
+        FILE* df = fd >= 0 ? fdopen(fd, "rb") : NULL;
+        if (df) {
+            fclose(s->f);
+            s->f = df;
+            s->mode = IMG_IO_DIRECT;
+            s->buf = buf_get();
+            return 0;
+        }
+        if (fd >= 0) close(fd);
+        want = IMG_IO_KERNEL;   /* the IMG's filesystem refuses O_DIRECT */
+    }
+#endif
+    if (want == IMG_IO_MMAP && (s->map = img_map(path, s->size)) != NULL) {
+        s->mode = IMG_IO_MMAP;   /* f stays open for page-cache hints */
+        return 0;
+    }
+#ifdef __linux__
+    s->mode = (want == IMG_IO_KERNEL || want == IMG_IO_URING) ? want : IMG_IO_STDIO;
+    struct stat st;
+    if (fstat(fileno(s->f), &st) == 0 && st.st_blksize > 0) {
+        s->blksize = (u64)st.st_blksize;
+        s->dev = st.st_dev;
+    } else {
+        s->no_clone = 1;
+    }
+#else
+    s->mode = IMG_IO_STDIO;
+#endif
+    s->buf = buf_get();
+    return 0;
+}
+
+static void img_close(ImgSource* s) {
+    if (s->map) {
+#ifdef _WIN32
+        UnmapViewOfFile((void*)s->map);
+#else
+        munmap((void*)s->map, (size_t)s->size);
+#endif
+    }
+    read_ahead_stop(s->ra);
+    if (s->f) fclose(s->f);
+    buf_put(s->buf);
+    memset(s, 0, sizeof(*s));
+}
+
+/* per-worker view: same handle and mapping, its own copy buffer and
+   counters. All reads are positional, so views never share a file
+   position. */
+static void img_view(const ImgSource* s, ImgSource* v) {
+    *v = *s;
+    v->buf = s->buf ? buf_get() : NULL;
+    v->ra = NULL;
+    v->via_cfr = v->via_sendfile = v->via_copy = v->via_uring = v->via_direct = v->read_ahead = 0;
+    v->willneed = v->dontneed = v->dropped_out = 0;
+    v->cloned = v->cloned_bytes = v->clone_unaligned = 0;
+}
+
+static void img_view_merge(ImgSource* s, ImgSource* v) {
+    s->via_cfr += v->via_cfr; s->via_sendfile += v->via_sendfile; s->via_copy += v->via_copy;
+    s->via_uring += v->via_uring; s->via_direct += v->via_direct;
+    s->no_direct_out |= v->no_direct_out;
+    s->willneed += v->willneed; s->dontneed += v->dontneed; s->dropped_out += v->dropped_out;
+    s->read_ahead += v->read_ahead;
+    s->cloned += v->cloned; s->cloned_bytes += v->cloned_bytes;
+    s->clone_unaligned += v->clone_unaligned;
+    s->no_cfr |= v->no_cfr; s->no_sendfile |= v->no_sendfile; s->no_clone |= v->no_clone;
+    read_ahead_stop(v->ra);
+    buf_put(v->buf);
+    v->buf = NULL;
+    v->ra = NULL;
+}
+
+typedef void (*chunk_fn)(void* ctx, const uint8_t* p, u64 pos, size_t len);
+
+/* read IMG [start, start + left) chunk by chunk and pass each to fn; once
+   a copy spans more than one chunk the next chunk is read on the helper
+   thread while fn runs. Returns the bytes read, short at EOF. */
+static u64 img_read_chunks(ImgSource* s, u64 start, u64 left, chunk_fn fn, void* ctx) {
+    size_t chunk = buf_pool.size;
+    if (left > chunk && !s->ra && !s->no_ra && !(s->ra = read_ahead_start(s->f, s->buf))) s->no_ra = 1;
+    u64 total = 0;
+    if (left <= chunk || !s->ra) {
+        while (left) {
+            size_t want = left > chunk ? chunk : (size_t)left;
+            size_t got = pread_full(s->f, s->buf, want, start + total);
+            if (got) fn(ctx, s->buf, start + total, got);
+            left -= got; total += got;
+            if (got < want) break;  /* reached EOF earlier than expected */
+        }
+        return total;
+    }
+    ReadAhead* r = s->ra;
+    int slot = 0;
+    size_t want = chunk;
+    read_ahead_post(r, slot, start, want);
+    for (;;) {
+        size_t got = read_ahead_wait(r);
+        u64 pos = start + total;
+        left -= got; total += got;
+        int more = got == want && left;
+        if (more) {
+            want = left > chunk ? chunk : (size_t)left;
+            read_ahead_post(r, slot ^ 1, pos + got, want);
+            ++s->read_ahead;
+        }
+        if (got) fn(ctx, r->buf[slot], pos, got);
+        if (!more) break;
+        slot ^= 1;
+    }
+    return total;
+}
+
+static void chunk_to_file(void* f, const uint8_t* p, u64 pos, size_t len) {
+    (void)pos;
+    fwrite(p, 1, len, (FILE*)f);
+}
+
+/* copy left bytes from IMG offset start to f without mmap */
+static u64 img_copy_range(ImgSource* s, u64 start, u64 left, FILE* f) {
+    u64 total = 0;
+#ifdef __linux__
+    if ((s->mode == IMG_IO_KERNEL || s->mode == IMG_IO_URING) && left) {
+        /* the header is still in f's buffer; the kernel writes at the fd offset */
+        if (fflush(f) != 0) return 0;
+        int in = fileno(s->f), out = fileno(f);
+        loff_t off = (loff_t)start;
+        while (left && !s->no_cfr) {
+            ssize_t n = copy_file_range(in, &off, out, NULL, (size_t)left, 0);
+            if (n > 0) { left -= (u64)n; total += (u64)n; s->via_cfr += (u64)n; continue; }
+            if (n == 0) return total;              /* IMG ended early */
+            if (errno != EINTR) s->no_cfr = 1;     /* not supported here; stop trying */
+        }
+        off_t soff = (off_t)(start + total);
+        while (left && !s->no_sendfile) {
+            size_t want = left > 0x7FFFF000u ? 0x7FFFF000u : (size_t)left;
+            ssize_t n = sendfile(out, in, &soff, want);
+            if (n > 0) { left -= (u64)n; total += (u64)n; s->via_sendfile += (u64)n; continue; }
+            if (n == 0) return total;
+            if (errno != EINTR) s->no_sendfile = 1;
+        }
+    }
+#endif
+    u64 got = img_read_chunks(s, start + total, left, chunk_to_file, f);
+    s->via_copy += got;
+    return total + got;
+}
+
+#if defined(__linux__) && defined(FICLONERANGE)
+/* Clone the body's aligned middle and copy the unaligned head and tail.
+   A clone needs source and destination offsets that are both multiples
+   of the block size, so the body's IMG offset and its offset in the
+   output (after the header) must agree modulo the block size. Returns
+   -1 without writing anything when cloning does not apply. */
+static int img_clone(ImgSource* s, u64 start, u64 end, FILE* f, u64* done) {
+    if (fflush(f) != 0) return -1;
+    int in = fileno(s->f), out = fileno(f);
+    struct stat st;
+    if (fstat(out, &st) != 0 || st.st_dev != s->dev) { s->no_clone = 1; return -1; }
+    off_t pos = lseek(out, 0, SEEK_CUR);
+    if (pos < 0) return -1;
+    u64 bs = s->blksize, len = end - start;
+    if ((start - (u64)pos) % bs != 0) { ++s->clone_unaligned; return -1; }
+    u64 head = ((u64)pos + bs - 1) / bs * bs - (u64)pos;
+    if (len < head + bs) return -1;
+    u64 mid = (len - head) / bs * bs;
+
+    u64 n = img_copy_range(s, start, head, f);
+    if (n != head || fflush(f) != 0) { *done = n; return 0; }
+    struct file_clone_range r;
+    r.src_fd = in;
+    r.src_offset = start + head;
+    r.src_length = mid;
+    r.dest_offset = (u64)pos + head;
+    if (ioctl(out, FICLONERANGE, &r) != 0) {
+        /* no reflink support here: stop trying; anything else is per body */
+        if (errno == EOPNOTSUPP || errno == ENOTTY || errno == EXDEV || errno == EINVAL)
+            s->no_clone = 1;
+        *done = head + img_copy_range(s, start + head, len - head, f);
+        return 0;
+    }
+    ++s->cloned; s->cloned_bytes += mid;
+    if (lseek(out, (off_t)(r.dest_offset + mid), SEEK_SET) < 0) { *done = head; return 0; }
+    *done = head + mid + img_copy_range(s, start + head + mid, len - head - mid, f);
+    return 0;
+}
+#endif
+
+/* ---- page-cache hints ----
+   --readahead K has the kernel start reading the next K bodies (in plan
+   order) before a worker reaches them. --drop-cache drops each body's IMG
+   range once it has been copied, and each finished WRLD once it is on
+   disk, so a large extraction does not leave gigabytes of cold data in
+   memory. O_DIRECT bypasses the cache already; without posix_fadvise
+   both are no-ops. */
+
+static void hint_img(ImgSource* s, u64 start, u64 end, int willneed) {
+#if !defined(_WIN32) && defined(POSIX_FADV_WILLNEED)
+    if (end <= start || s->mode == IMG_IO_DIRECT) return;
+    /* the kernel drops only whole pages inside the range, which for small
+       bodies is none; the plan has finished with the pages shared with
+       the neighbours, or will fetch them again */
+    u64 pg = (u64)sysconf(_SC_PAGESIZE);
+    u64 a = start & ~(pg - 1);
+    u64 z = end + pg - 1 < s->size ? (end + pg - 1) & ~(pg - 1) : s->size;
+    if (!willneed && s->map) {
+        /* pages still mapped here would stay resident */
+        madvise((void*)(s->map + a), (size_t)(z - a), MADV_DONTNEED);
+    }
+    posix_fadvise(fileno(s->f), (off_t)a, (off_t)(z - a),
+                  willneed ? POSIX_FADV_WILLNEED : POSIX_FADV_DONTNEED);
+    if (willneed) s->willneed += end - start;
+    else s->dontneed += end - start;
+#else
+    (void)s; (void)start; (void)end; (void)willneed;
+#endif
+}
+
+/* dirty pages cannot be dropped, so the WRLD is written back first */
+static void drop_output(ImgSource* s, int fd) {
+#if !defined(_WIN32) && defined(POSIX_FADV_DONTNEED)
+#ifdef __linux__
+    sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                              SYNC_FILE_RANGE_WAIT_AFTER);
+#else
+    fsync(fd);
+#endif
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ++s->dropped_out;
+#else
+    (void)s; (void)fd;
+#endif
+}
+
+/* copy IMG slice [start, end) to f, returns bytes written */
+static u64 img_copy(ImgSource* s, u64 start, u64 end, FILE* f) {
+    u64 left = (end > start) ? (end - start) : 0;
+    if (s->mode == IMG_IO_MMAP) {
+#ifndef _WIN32
+        /* start the read-in for the whole body before the first fault */
+        size_t pg = (size_t)sysconf(_SC_PAGESIZE);
+        u64 a = start & ~(u64)(pg - 1);
+        if (left) madvise((void*)(s->map + a), (size_t)(end - a), MADV_WILLNEED);
+#endif
+        return fwrite(s->map + start, 1, (size_t)left, f);
+    }
+#if defined(__linux__) && defined(FICLONERANGE)
+    u64 done = 0;
+    if ((s->mode == IMG_IO_KERNEL || s->mode == IMG_IO_URING) && !s->no_clone && left
+        && img_clone(s, start, end, f, &done) == 0)
+        return done;
+#endif
+    return img_copy_range(s, start, left, f);
+}
+
+/* the body's IMG range clipped to the IMG, without logging; empty when
+   only the header is written */
+static void body_span(const WrldHeader* h, u64 img_size, u64* start, u64* end) {
+    *start = (u64)h->continuation;
+    *end = *start + (h->total_size >= 32 ? (u64)h->total_size - 32ull : 0ull);
+    if (*start > img_size) *start = *end = img_size;
+    if (*end > img_size) *end = img_size;
+}
+
+/* IMG range [start, end) of the body, clipped to the IMG; -1 if the
+   body starts past the end and only the header is written */
+static int wrld_body_range(const WrldHeader* h, u64 img_size, u64* start, u64* end, StrBuf* log) {
+    *start = (u64)h->continuation;
+    u64 need = (h->total_size >= 32) ? ((u64)h->total_size - 32ull) : 0ull;
+    *end = *start + need;
+    if (*start > img_size) {
+        sb_printf(log, "[warn] continuation start beyond IMG (%llu > %llu); writing header only\n",
+                  (unsigned long long)*start, (unsigned long long)img_size);
+        return -1;
+    }
+    if (*end > img_size) {
+        sb_printf(log, "[warn] continuation clipped (%llu -> %llu)\n",
+                  (unsigned long long)*end, (unsigned long long)img_size);
+        *end = img_size;
+    }
+    return 0;
+}
+
+#ifdef __linux__
+/* O_DIRECT output: header and body are staged in an aligned chunk buffer
+   and written in whole chunks; the last block is zero-padded and the file
+   truncated back to its real length. IMG reads are widened to aligned
+   offsets and trimmed to the body here. */
+typedef struct {
+    int fd, err;
+    uint8_t* stage;
+    size_t fill;
+    u64 off;            /* file offset of stage[0] */
+    u64 start, end;     /* body range in the IMG */
+    u64 body;
+} DirectOut;
+
+static void direct_flush(DirectOut* d, size_t len) {
+    if (!d->err && pwrite(d->fd, d->stage, len, (off_t)d->off) != (ssize_t)len) d->err = 1;
+    d->off += len;
+    d->fill = 0;
+}
+
+static void direct_put(DirectOut* d, const uint8_t* p, size_t n) {
+    while (n) {
+        size_t k = buf_pool.size - d->fill;
+        if (k > n) k = n;
+        memcpy(d->stage + d->fill, p, k);
+        d->fill += k; p += k; n -= k;
+        if (d->fill == buf_pool.size) direct_flush(d, d->fill);
+    }
+}
+
+static void direct_chunk(void* ctx, const uint8_t* p, u64 pos, size_t len) {
+    DirectOut* d = (DirectOut*)ctx;
+    u64 lo = d->start > pos ? d->start : pos;
+    u64 hi = d->end < pos + len ? d->end : pos + len;
+    if (hi > lo) {
+        direct_put(d, p + (lo - pos), (size_t)(hi - lo));
+        d->body += hi - lo;
+    }
+}
+
+static int write_wrld_direct(const WrldHeader* h, ImgSource* img,
+                             const char* out_path, int drop, StrBuf* log) {
+    DirectOut d; memset(&d, 0, sizeof(d));
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    d.fd = img->no_direct_out ? -1 : open(out_path, flags | O_DIRECT, 0666);
+    if (d.fd < 0 && (img->no_direct_out || errno == EINVAL)) {
+        img->no_direct_out = 1;     /* e.g. tmpfs: write through the page cache */
+        d.fd = open(out_path, flags, 0666);
+    }
+    if (d.fd < 0) {
+        sb_printf(log, "[error] cannot write %s (%s)\n", out_path, strerror(errno));
+        return -1;
+    }
+    d.stage = buf_get();
+    direct_put(&d, h->raw, 32);
+
+    int body = wrld_body_range(h, img->size, &d.start, &d.end, log) == 0;
+    if (body && d.end > d.start) {
+        u64 a = d.start / BUF_ALIGN * BUF_ALIGN;
+        u64 z = (d.end + BUF_ALIGN - 1) / BUF_ALIGN * BUF_ALIGN;
+        img_read_chunks(img, a, z - a, direct_chunk, &d);
+        img->via_direct += d.body;
+    }
+    u64 len = d.off + d.fill;
+    if (d.fill) {
+        size_t padded = (d.fill + BUF_ALIGN - 1) / BUF_ALIGN * BUF_ALIGN;
+        memset(d.stage + d.fill, 0, padded - d.fill);
+        direct_flush(&d, padded);
+        if (!d.err && ftruncate(d.fd, (off_t)len) != 0) d.err = 1;
+    }
+    if (drop && img->no_direct_out) drop_output(img, d.fd);
+    close(d.fd);
+    buf_put(d.stage);
+    if (d.err) sb_printf(log, "[warn] body transfer incomplete for %s\n", out_path);
+    if (!body) return 0;
+    sb_printf(log, "[build] %s header=32 body=%llu total_out=%llu (expected %u)\n",
+              out_path, (unsigned long long)d.body,
+              (unsigned long long)(32ull + d.body), h->total_size);
+    return 0;
+}
+#endif
+
+/* drop: --drop-cache, see hint_img */
+static int write_wrld(const WrldHeader* h, ImgSource* img,
+                      const char* out_path, int drop, StrBuf* log) {
+#ifdef __linux__
+    if (img->mode == IMG_IO_DIRECT) return write_wrld_direct(h, img, out_path, drop, log);
+#endif
+    u64 img_size = img->size;
+    FILE* f = fopen(out_path, "wb");
+    if (!f) {
+        sb_printf(log, "[error] cannot write %s (%s)\n", out_path, strerror(errno));
+        return -1;
+    }
+    /* header */
+    if (fwrite(h->raw, 1, 32, f) != 32) {
+        sb_printf(log, "[error] write header failed for %s\n", out_path);
+        fclose(f);
+        return -2;
+    }
+
+    /* body */
+    u64 start, end;
+    if (wrld_body_range(h, img_size, &start, &end, log) != 0) {
+        fclose(f);
+        return 0;
+    }
+
+    u64 body = img_copy(img, start, end, f);
+    sb_printf(log, "[build] %s header=32 body=%llu total_out=%llu (expected %u)\n",
+              out_path, (unsigned long long)body,
+              (unsigned long long)(32ull + body), h->total_size);
+    if (drop) {
+        fflush(f);
+        drop_output(img, fileno(f));
+        hint_img(img, start, end, 0);
+    }
+    fclose(f);
+    return 0;
+}
+
+typedef struct {
+    const char* out_dir;
+    ImgSource img;
+    FILE* log;
+    StrBuf sb;          /* log lines of the WRLD being written */
+    int log_scan;       /* log headers as they are extracted (streaming) */
+    unsigned qd;        /* io_uring queue depth */
+    int plan;           /* visit bodies in IMG order (see IoPlan) */
+    unsigned readahead; /* WILLNEED this many bodies ahead */
+    int drop_cache;     /* DONTNEED copied IMG ranges and finished WRLDs */
+    long long gap;      /* coalesce bodies this close together; -1 = do not */
+    Alloc* al;          /* per-file tables and staged log text */
+    size_t written;
+} ExtractCtx;
+
+/* the scan line for the first headers, when they are logged at extraction */
+static void log_scan_line(const ExtractCtx* x, const WrldHeader* h, size_t idx, StrBuf* sb) {
+    if (x->log_scan && idx < 50) {
+        sb_printf(sb, "[scan] [%zu] @LVZ+0x%08X type=%u size=%u g0=0x%X g1=0x%X gcnt=%u cont=0x%X\n",
+                  idx, (unsigned)h->lvz_off, h->wrld_type, h->total_size,
+                  h->global0, h->global1, h->global_count, h->continuation);
+    }
+}
+
+static void wrld_name(const ExtractCtx* x, size_t idx, char* name, size_t namesz,
+                      char* path, size_t pathsz) {
+    snprintf(name, namesz, "wrld_%04zu.wrld", idx);
+    path_join(path, pathsz, x->out_dir, name);
+}
+
+/* write one WRLD; its log lines are appended to sb. 0 on success. */
+static int extract_one(const ExtractCtx* x, ImgSource* img, const WrldHeader* h,
+                       size_t idx, StrBuf* sb) {
+    log_scan_line(x, h, idx, sb);
+    char name[256], out_path[1400];
+    wrld_name(x, idx, name, sizeof(name), out_path, sizeof(out_path));
+    int rc = write_wrld(h, img, out_path, x->drop_cache, sb);
+    if (rc != 0) sb_printf(sb, "[warn] failed to write %s (rc=%d)\n", name, rc);
+    return rc;
+}
+
+static void extract_header(const WrldHeader* h, size_t idx, void* arg) {
+    ExtractCtx* x = (ExtractCtx*)arg;
+    if (extract_one(x, &x->img, h, idx, &x->sb) == 0) ++x->written;
+    sb_flush(&x->sb, x->log);
+}
+
+typedef void (*header_at_fn)(const void* src, size_t i, WrldHeader* h);
+
+/* ---- I/O planning ----
+   Headers are numbered in LVZ order, but their bodies are scattered over
+   the IMG, so extracting in that order reads the IMG at random. The plan
+   visits bodies by continuation offset instead. With a gap threshold,
+   bodies that overlap or lie within gap bytes of each other form a run
+   that is read front to back in one pass and cut into its WRLDs; the
+   bytes between them are read and dropped. File names and the log still
+   follow header order. --stream extracts headers as they are found, so
+   it is not planned. */
+
+#define PLAN_MAX_OPEN 64u   /* WRLDs a run may have open at once */
+
+typedef struct {
+    size_t idx;
+    u64 start, end;         /* clipped body range; empty if header only */
+} PlanItem;
+
+typedef struct {
+    size_t* order;          /* header indices by body start */
+    size_t* run;            /* run k is order[run[k] .. run[k + 1]) */
+    size_t nruns;
+    size_t merged;          /* bodies in runs of more than one */
+    u64 gap_bytes;          /* IMG bytes read only to bridge gaps */
+    Alloc* al;
+} IoPlan;
+
+static int cmp_plan_item(const void* a, const void* b) {
+    const PlanItem* x = (const PlanItem*)a;
+    const PlanItem* y = (const PlanItem*)b;
+    if (x->start != y->start) return x->start < y->start ? -1 : 1;
+    return x->idx < y->idx ? -1 : x->idx > y->idx;
+}
+
+static void plan_build(IoPlan* p, Alloc* al, size_t n, header_at_fn at, const void* src, u64 img_size,
+                       long long gap) {
+    PlanItem* it = (PlanItem*)al->alloc(al, n * sizeof(PlanItem));
+    for (size_t i = 0; i < n; ++i) {
+        WrldHeader h;
+        at(src, i, &h);
+        it[i].idx = i;
+        body_span(&h, img_size, &it[i].start, &it[i].end);
+    }
+    qsort(it, n, sizeof(PlanItem), cmp_plan_item);
+
+    memset(p, 0, sizeof(*p));
+    p->al = al;
+    p->order = (size_t*)al->alloc(al, n * sizeof(size_t));
+    p->run = (size_t*)al->alloc(al, (n + 1) * sizeof(size_t));
+    u64 run_end = 0, ends[PLAN_MAX_OPEN];
+    size_t open = 0, run_len = 0;
+    for (size_t k = 0; k < n; ++k) {
+        p->order[k] = it[k].idx;
+        int body = it[k].end > it[k].start;
+        /* bodies still being written when this one starts */
+        size_t live = 0;
+        for (size_t e = 0; e < open; ++e) if (ends[e] > it[k].start) ends[live++] = ends[e];
+        open = live;
+        if (gap >= 0 && body && run_len && open < PLAN_MAX_OPEN
+            && it[k].start <= run_end + (u64)gap) {
+            if (it[k].start > run_end) p->gap_bytes += it[k].start - run_end;
+            if (run_len == 1) ++p->merged;
+            ++p->merged; ++run_len;
+        } else {
+            p->run[p->nruns++] = k;
+            run_len = body ? 1 : 0;     /* header-only WRLDs stay on their own */
+            run_end = 0; open = 0;
+        }
+        if (body) {
+            ends[open++] = it[k].end;
+            if (it[k].end > run_end) run_end = it[k].end;
+        }
+    }
+    p->run[p->nruns] = n;
+    al->release(al, it);
+}
+
+static void plan_free(IoPlan* p) {
+    p->al->release(p->al, p->order);
+    p->al->release(p->al, p->run);
+    memset(p, 0, sizeof(*p));
+}
+
+/* ---- parallel extraction ----
+   -j N workers take header indices (or plan runs) from a shared counter
+   and write their WRLDs independently. Each job's log lines are buffered
+   and emitted strictly in index order, so the log and the written count
+   match a serial run. A planned serial run goes through here with one
+   worker. */
+
+typedef struct {
+    ExtractCtx* x;
+    header_at_fn at;
+    const void* src;
+    const IoPlan* plan;     /* NULL: one job per header */
+    size_t n;
+    size_t jobs;            /* headers, or plan runs */
+    size_t next;            /* next job to hand out */
+    size_t hinted;          /* jobs below this have had WILLNEED */
+    size_t emit;            /* next index whose log is due */
+    StrBuf* logs;
+    unsigned char* state;   /* 0 pending, 1 written, 2 failed */
+    mutex_t mu;
+} ExtractPool;
+
+typedef struct {
+    ExtractPool* pool;
+    ImgSource img;
+} ExtractWorker;
+
+static void pool_done(ExtractPool* p, size_t i, StrBuf* sb, int rc) {
+    mutex_lock(&p->mu);
+    p->logs[i] = *sb;
+    p->state[i] = rc == 0 ? 1 : 2;
+    for (; p->emit < p->n && p->state[p->emit]; ++p->emit) {
+        sb_flush(&p->logs[p->emit], p->x->log);
+        sb_free(&p->logs[p->emit]);
+        if (p->state[p->emit] == 1) ++p->x->written;
+    }
+    mutex_unlock(&p->mu);
+}
+
+typedef struct {
+    size_t idx;
+    FILE* f;
+    char path[1400];
+    u64 start, end, bytes;
+    uint32_t total_size;
+    StrBuf log;
+} RunBody;
+
+/* open a run member and write its header; -1 once it has been reported */
+static int run_body_open(ExtractPool* p, ImgSource* img, RunBody* b) {
+    WrldHeader h;
+    p->at(p->src, b->idx, &h);
+    log_scan_line(p->x, &h, b->idx, &b->log);
+    char name[256];
+    wrld_name(p->x, b->idx, name, sizeof(name), b->path, sizeof(b->path));
+    b->total_size = h.total_size;
+    b->bytes = 0;
+    int rc = 0;
+    b->f = fopen(b->path, "wb");
+    if (!b->f) {
+        sb_printf(&b->log, "[error] cannot write %s (%s)\n", b->path, strerror(errno));
+        rc = -1;
+    } else if (fwrite(h.raw, 1, 32, b->f) != 32) {
+        sb_printf(&b->log, "[error] write header failed for %s\n", b->path);
+        fclose(b->f);
+        rc = -2;
+    } else {
+        wrld_body_range(&h, img->size, &b->start, &b->end, &b->log);
+        return 0;
+    }
+    sb_printf(&b->log, "[warn] failed to write %s (rc=%d)\n", name, rc);
+    pool_done(p, b->idx, &b->log, rc);
+    return -1;
+}
+
+static void run_body_close(ExtractPool* p, ImgSource* img, RunBody* b) {
+    sb_printf(&b->log, "[build] %s header=32 body=%llu total_out=%llu (expected %u)\n",
+              b->path, (unsigned long long)b->bytes,
+              (unsigned long long)(32ull + b->bytes), b->total_size);
+    if (p->x->drop_cache) {
+        fflush(b->f);
+        drop_output(img, fileno(b->f));
+    }
+    fclose(b->f);
+    pool_done(p, b->idx, &b->log, 0);
+}
+
+typedef struct {
+    ExtractPool* p;
+    ImgSource* img;
+    RunBody* bs;
+    RunBody** open;
+    size_t n, nopen, next;
+} RunRead;
+
+/* write the part of chunk [pos, to) that belongs to b; 1 once b is
+   complete and closed */
+static int run_body_feed(RunRead* rr, RunBody* b, const uint8_t* buf, u64 pos, u64 to) {
+    u64 lo = b->start > pos ? b->start : pos;
+    u64 hi = b->end < to ? b->end : to;
+    if (hi > lo) {
+        b->bytes += fwrite(buf + (lo - pos), 1, (size_t)(hi - lo), b->f);
+        rr->img->via_copy += hi - lo;
+    }
+    if (b->end > to) return 0;
+    run_body_close(rr->p, rr->img, b);
+    return 1;
+}
+
+/* hand one chunk to the bodies already open, then to the ones it reaches */
+static void run_chunk(void* ctx, const uint8_t* buf, u64 pos, size_t len) {
+    RunRead* rr = (RunRead*)ctx;
+    u64 to = pos + len;
+    size_t live = 0;
+    for (size_t k = 0; k < rr->nopen; ++k)
+        if (!run_body_feed(rr, rr->open[k], buf, pos, to)) rr->open[live++] = rr->open[k];
+    for (; rr->next < rr->n && rr->bs[rr->next].start < to; ++rr->next) {
+        RunBody* b = &rr->bs[rr->next];
+        if (run_body_open(rr->p, rr->img, b) == 0 && !run_body_feed(rr, b, buf, pos, to))
+            rr->open[live++] = b;
+    }
+    rr->nopen = live;
+}
+
+/* read a coalesced run front to back and cut it into its WRLDs; a body
+   is opened when the read reaches it and closed once complete */
+static void extract_run(ExtractPool* p, ImgSource* img, const size_t* idx, size_t n) {
+    RunRead rr; memset(&rr, 0, sizeof(rr));
+    rr.p = p; rr.img = img; rr.n = n;
+    Alloc* al = p->x->al;
+    rr.bs = (RunBody*)al->alloc(al, n * sizeof(RunBody));
+    rr.open = (RunBody**)al->alloc(al, n * sizeof(RunBody*));
+    u64 start = 0, end = 0;
+    for (size_t k = 0; k < n; ++k) {
+        WrldHeader h;
+        memset(&rr.bs[k], 0, sizeof(RunBody));
+        rr.bs[k].idx = idx[k];
+        rr.bs[k].log.al = al;
+        p->at(p->src, idx[k], &h);
+        body_span(&h, img->size, &rr.bs[k].start, &rr.bs[k].end);
+        if (k == 0) start = rr.bs[k].start;
+        if (rr.bs[k].end > end) end = rr.bs[k].end;
+    }
+    img_read_chunks(img, start, end - start, run_chunk, &rr);
+    /* anything left means the IMG ended early */
+    for (size_t k = 0; k < rr.nopen; ++k) run_body_close(p, img, rr.open[k]);
+    for (; rr.next < n; ++rr.next)
+        if (run_body_open(p, img, &rr.bs[rr.next]) == 0) run_body_close(p, img, &rr.bs[rr.next]);
+    if (p->x->drop_cache) hint_img(img, start, end, 0);
+    al->release(al, rr.open);
+    al->release(al, rr.bs);
+}
+
+/* WILLNEED for the bodies of the next readahead jobs after j that no
+   worker has hinted yet */
+static void pool_hint(ExtractPool* p, ImgSource* img, size_t j) {
+    size_t k = p->x->readahead;
+    if (!k) return;
+    mutex_lock(&p->mu);
+    size_t from = p->hinted > j + 1 ? p->hinted : j + 1;
+    size_t to = j + 1 + k < p->jobs ? j + 1 + k : p->jobs;
+    if (to > p->hinted) p->hinted = to;
+    mutex_unlock(&p->mu);
+    for (size_t u = from; u < to; ++u) {
+        size_t a = u, b = u + 1;
+        if (p->plan) { a = p->plan->run[u]; b = p->plan->run[u + 1]; }
+        for (size_t q = a; q < b; ++q) {
+            WrldHeader h; u64 s0, s1;
+            p->at(p->src, p->plan ? p->plan->order[q] : q, &h);
+            body_span(&h, img->size, &s0, &s1);
+            hint_img(img, s0, s1, 1);
+        }
+    }
+}
+
+static void* extract_worker_main(void* arg) {
+    ExtractWorker* w = (ExtractWorker*)arg;
+    ExtractPool* p = w->pool;
+    for (;;) {
+        mutex_lock(&p->mu);
+        size_t j = p->next < p->jobs ? p->next++ : p->jobs;
+        mutex_unlock(&p->mu);
+        if (j >= p->jobs) break;
+        pool_hint(p, &w->img, j);
+
+        const size_t* idx = &j;
+        size_t cnt = 1;
+        if (p->plan) {
+            idx = p->plan->order + p->plan->run[j];
+            cnt = p->plan->run[j + 1] - p->plan->run[j];
+        }
+        if (cnt > 1 && w->img.mode != IMG_IO_MMAP && w->img.mode != IMG_IO_DIRECT) {
+            extract_run(p, &w->img, idx, cnt);
+            continue;
+        }
+        for (size_t k = 0; k < cnt; ++k) {
+            WrldHeader h;
+            p->at(p->src, idx[k], &h);
+            StrBuf sb = { NULL, 0, 0, p->x->al };
+            int rc = extract_one(p->x, &w->img, &h, idx[k], &sb);
+            pool_done(p, idx[k], &sb, rc);
+        }
+    }
+    return NULL;
+}
+
+#define URING_CHUNK_KIB  256u
+#define URING_QD_DEFAULT 32u
+
+#ifdef UNIMG_URING
+/* ---- io_uring extraction ----
+   Bodies are cut into URING_CHUNK pieces. Each piece is a read from the
+   IMG linked to a write at the matching offset of its WRLD, both on a
+   registered buffer, so a single submission covers the whole copy and up
+   to qd pieces from many WRLDs are in flight together. Files are opened,
+   given their header and closed synchronously; log lines are emitted in
+   index order as with the worker pool. Uses the raw syscalls, so there
+   is no liburing dependency. */
+
+#define URING_CHUNK      (URING_CHUNK_KIB << 10)
+#define URING_MAX_QD     4096u
+
+typedef struct {
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    void* sq_map; size_t sq_map_len;
+    void* cq_map; size_t cq_map_len;
+    size_t sqes_len;
+    unsigned sq_entries;
+    unsigned tail;          /* local SQ tail, published by uring_submit */
+    unsigned to_submit;
+} URing;
+
+static void uring_free(URing* r) {
+    if (r->sqes) munmap(r->sqes, r->sqes_len);
+    if (r->cq_map && r->cq_map != r->sq_map) munmap(r->cq_map, r->cq_map_len);
+    if (r->sq_map) munmap(r->sq_map, r->sq_map_len);
+    if (r->fd >= 0) close(r->fd);
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+}
+
+static void* uring_map(int fd, size_t len, off_t off) {
+    void* p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, off);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+static int uring_init(URing* r, unsigned entries) {
+    memset(r, 0, sizeof(*r));
+    struct io_uring_params p; memset(&p, 0, sizeof(p));
+    r->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0) return -1;
+
+    r->sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    int single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single) {
+        if (r->cq_map_len > r->sq_map_len) r->sq_map_len = r->cq_map_len;
+        r->cq_map_len = r->sq_map_len;
+    }
+    r->sq_map = uring_map(r->fd, r->sq_map_len, IORING_OFF_SQ_RING);
+    r->cq_map = single ? r->sq_map : uring_map(r->fd, r->cq_map_len, IORING_OFF_CQ_RING);
+    r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = (struct io_uring_sqe*)uring_map(r->fd, r->sqes_len, IORING_OFF_SQES);
+    if (!r->sq_map || !r->cq_map || !r->sqes) { uring_free(r); return -1; }
+
+    uint8_t* sq = (uint8_t*)r->sq_map;
+    uint8_t* cq = (uint8_t*)r->cq_map;
+    r->sq_head  = (unsigned*)(sq + p.sq_off.head);
+    r->sq_tail  = (unsigned*)(sq + p.sq_off.tail);
+    r->sq_mask  = (unsigned*)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned*)(sq + p.sq_off.array);
+    r->cq_head  = (unsigned*)(cq + p.cq_off.head);
+    r->cq_tail  = (unsigned*)(cq + p.cq_off.tail);
+    r->cq_mask  = (unsigned*)(cq + p.cq_off.ring_mask);
+    r->cqes     = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    r->sq_entries = p.sq_entries;
+    r->tail = *r->sq_tail;
+    return 0;
+}
+
+static struct io_uring_sqe* uring_sqe(URing* r) {
+    unsigned head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+    if (r->tail - head >= r->sq_entries) return NULL;
+    unsigned idx = r->tail & *r->sq_mask;
+    r->sq_array[idx] = idx;
+    ++r->tail; ++r->to_submit;
+    struct io_uring_sqe* e = &r->sqes[idx];
+    memset(e, 0, sizeof(*e));
+    return e;
+}
+
+/* publish queued entries and wait for at least `wait` completions */
+static int uring_submit(URing* r, unsigned wait) {
+    __atomic_store_n(r->sq_tail, r->tail, __ATOMIC_RELEASE);
+    for (;;) {
+        int rc = (int)syscall(__NR_io_uring_enter, r->fd, r->to_submit, wait,
+                              wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (rc >= 0) { r->to_submit -= (unsigned)rc; return 0; }
+        if (errno != EINTR) return -1;
+    }
+}
+
+static void uring_prep(struct io_uring_sqe* e, int op, int fd, void* buf, unsigned len,
+                       u64 off, int buf_index, u64 user_data) {
+    e->opcode = (uint8_t)op;
+    e->fd = fd;
+    e->addr = (u64)(uintptr_t)buf;
+    e->len = len;
+    e->off = off;
+    e->user_data = user_data;
+    if (buf_index >= 0) e->buf_index = (uint16_t)buf_index;
+}
+
+typedef struct {
+    int fd;
+    uint32_t total_size;
+    u64 start, end;         /* IMG body range */
+    u64 next;               /* next IMG offset to queue */
+    u64 bytes;              /* body bytes written */
+    unsigned inflight;
+    int err;
+    StrBuf log;
+    unsigned char state;    /* 0 pending, 1 written, 2 failed */
+} UJob;
+
+typedef struct {
+    size_t job;
+    unsigned len;
+} USlot;
+
+/* open the WRLD and write its header; returns 0 if a body remains to be
+   queued, otherwise the job is already finished */
+static int uring_job_open(const ExtractCtx* x, UJob* j, size_t idx, header_at_fn at, const void* src) {
+    WrldHeader h;
+    at(src, idx, &h);
+    log_scan_line(x, &h, idx, &j->log);
+    char name[256], out_path[1400];
+    wrld_name(x, idx, name, sizeof(name), out_path, sizeof(out_path));
+    j->total_size = h.total_size;
+    j->fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (j->fd < 0) {
+        sb_printf(&j->log, "[error] cannot write %s (%s)\n", out_path, strerror(errno));
+        sb_printf(&j->log, "[warn] failed to write %s (rc=%d)\n", name, -1);
+        j->state = 2;
+        return -1;
+    }
+    if (pwrite(j->fd, h.raw, 32, 0) != 32) {
+        sb_printf(&j->log, "[error] write header failed for %s\n", out_path);
+        sb_printf(&j->log, "[warn] failed to write %s (rc=%d)\n", name, -2);
+        close(j->fd);
+        j->state = 2;
+        return -1;
+    }
+    if (wrld_body_range(&h, x->img.size, &j->start, &j->end, &j->log) != 0) {
+        close(j->fd);
+        j->state = 1;
+        return -1;
+    }
+    j->next = j->start;
+    if (j->start == j->end) {
+        sb_printf(&j->log, "[build] %s header=32 body=0 total_out=32 (expected %u)\n",
+                  out_path, h.total_size);
+        close(j->fd);
+        j->state = 1;
+        return -1;
+    }
+    return 0;
+}
+
+static void uring_job_finish(ExtractCtx* x, UJob* j, size_t idx) {
+    char name[256], out_path[1400];
+    wrld_name(x, idx, name, sizeof(name), out_path, sizeof(out_path));
+    if (x->drop_cache) {
+        drop_output(&x->img, j->fd);
+        hint_img(&x->img, j->start, j->end, 0);
+    }
+    close(j->fd);
+    if (j->err) sb_printf(&j->log, "[warn] body transfer incomplete for %s\n", out_path);
+    sb_printf(&j->log, "[build] %s header=32 body=%llu total_out=%llu (expected %u)\n",
+              out_path, (unsigned long long)j->bytes,
+              (unsigned long long)(32ull + j->bytes), j->total_size);
+    j->state = 1;
+}
+
+/* 0 when all n WRLDs were handled, -1 if io_uring is not available (nothing
+   was written then). order, if given, is the sequence to queue bodies in. */
+static int extract_all_uring(ExtractCtx* x, size_t n, header_at_fn at, const void* src,
+                             const size_t* order) {
+    unsigned qd = x->qd ? x->qd : URING_QD_DEFAULT;
+    if (qd > URING_MAX_QD) qd = URING_MAX_QD;
+    URing r;
+    if (uring_init(&r, qd * 2) != 0) return -1;
+
+    uint8_t* pool = (uint8_t*)big_alloc((size_t)qd * URING_CHUNK);
+    struct iovec* iov = (struct iovec*)x->al->alloc(x->al, qd * sizeof(struct iovec));
+    for (unsigned k = 0; k < qd; ++k) {
+        iov[k].iov_base = pool + (size_t)k * URING_CHUNK;
+        iov[k].iov_len = URING_CHUNK;
+    }
+    /* fixed buffers need locked memory; plain reads and writes do not */
+    int fixed = syscall(__NR_io_uring_register, r.fd, IORING_REGISTER_BUFFERS, iov, qd) == 0;
+    fprintf(x->log, "[io] io_uring: queue depth %u, %s buffers\n", qd, fixed ? "registered" : "plain");
+
+    UJob* jobs = (UJob*)x->al->alloc(x->al, n * sizeof(UJob));
+    memset(jobs, 0, n * sizeof(UJob));
+    for (size_t k = 0; k < n; ++k) jobs[k].log.al = x->al;
+    USlot* slots = (USlot*)x->al->alloc(x->al, qd * sizeof(USlot));
+    unsigned* free_slots = (unsigned*)x->al->alloc(x->al, qd * sizeof(unsigned));
+    unsigned nfree = qd;
+    for (unsigned k = 0; k < qd; ++k) free_slots[k] = qd - 1 - k;
+    int img_fd = fileno(x->img.f);
+    const size_t NONE = (size_t)-1;
+    size_t next_job = 0, cur = NONE, emit = 0, hinted = 0;
+
+    while (emit < n) {
+        /* queue read->write pairs while buffers are free */
+        while (nfree) {
+            if (cur == NONE) {
+                if (next_job >= n) break;
+                cur = order ? order[next_job] : next_job;
+                for (; x->readahead && hinted < n && hinted <= next_job + x->readahead; ++hinted) {
+                    WrldHeader h; u64 s0, s1;
+                    at(src, order ? order[hinted] : hinted, &h);
+                    body_span(&h, x->img.size, &s0, &s1);
+                    hint_img(&x->img, s0, s1, 1);
+                }
+                ++next_job;
+                if (uring_job_open(x, &jobs[cur], cur, at, src) != 0) { cur = NONE; continue; }
             }
-            hits++;
+            UJob* j = &jobs[cur];
+            u64 left = j->end - j->next;
+            unsigned len = left > URING_CHUNK ? URING_CHUNK : (unsigned)left;
+            unsigned slot = free_slots[--nfree];
+            uint8_t* buf = pool + (size_t)slot * URING_CHUNK;
+            struct io_uring_sqe* rd = uring_sqe(&r);
+            struct io_uring_sqe* wr = uring_sqe(&r);
+            uring_prep(rd, fixed ? IORING_OP_READ_FIXED : IORING_OP_READ, img_fd, buf, len,
+                       j->next, fixed ? (int)slot : -1, (u64)slot * 2);
+            rd->flags = IOSQE_IO_LINK;
+            uring_prep(wr, fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE, j->fd, buf, len,
+                       32 + (j->next - j->start), fixed ? (int)slot : -1, (u64)slot * 2 + 1);
+            slots[slot].job = cur;
+            slots[slot].len = len;
+            ++j->inflight;
+            j->next += len;
+            if (j->next == j->end) cur = NONE;
+        }
+
+        if (nfree < qd) {
+            if (uring_submit(&r, 1) != 0) die("io_uring_enter failed: %s", strerror(errno));
+            unsigned head = *r.cq_head;
+            unsigned tail = __atomic_load_n(r.cq_tail, __ATOMIC_ACQUIRE);
+            for (; head != tail; ++head) {
+                const struct io_uring_cqe* c = &r.cqes[head & *r.cq_mask];
+                unsigned slot = (unsigned)(c->user_data >> 1);
+                USlot* sl = &slots[slot];
+                UJob* j = &jobs[sl->job];
+                /* a failed or short read cancels its write, which still completes */
+                if (c->res != (int)sl->len) j->err = 1;
+                if (!(c->user_data & 1)) continue;
+                if (c->res > 0) { j->bytes += (u64)c->res; x->img.via_uring += (u64)c->res; }
+                free_slots[nfree++] = slot;
+                if (--j->inflight == 0 && j->next == j->end) uring_job_finish(x, j, sl->job);
+            }
+            __atomic_store_n(r.cq_head, head, __ATOMIC_RELEASE);
+        }
+
+        for (; emit < n && jobs[emit].state; ++emit) {
+            sb_flush(&jobs[emit].log, x->log);
+            sb_free(&jobs[emit].log);
+            if (jobs[emit].state == 1) ++x->written;
         }
-        i = j + 4;
     }
 
-    /* sort and dedupe by lvz_off */
-    qsort(out->items, out->count, sizeof(WrldHeader), cmp_by_lvz_off);
-    size_t w = 0;
-    for (size_t r = 0; r < out->count; ++r) {
-        if (w == 0 || out->items[r].lvz_off != out->items[w-1].lvz_off) {
-            out->items[w++] = out->items[r];
+    x->al->release(x->al, free_slots); x->al->release(x->al, slots);
+    x->al->release(x->al, jobs);
+    uring_free(&r);
+    huge_report(x->log, "during io_uring copies");
+    x->al->release(x->al, iov); big_free(pool);
+    return 0;
+}
+#endif
+
+static void extract_all(ExtractCtx* x, size_t n, header_at_fn at, const void* src, int jobs) {
+    IoPlan plan;
+    const IoPlan* pl = NULL;
+    if (x->plan && n > 1) {
+        plan_build(&plan, x->al, n, at, src, x->img.size, x->gap);
+        pl = &plan;
+        fprintf(x->log, "[io] plan: %zu WRLDs in IMG order", n);
+        if (x->gap >= 0)
+            fprintf(x->log, ", %zu sequential runs (%zu bodies coalesced, %llu gap bytes)", plan.nruns,
+                    plan.merged, (unsigned long long)plan.gap_bytes);
+        fprintf(x->log, "\n");
+    }
+    if (pl && x->gap >= 0 && x->img.mode == IMG_IO_DIRECT)
+        fprintf(x->log, "[io] O_DIRECT keeps the order but does not coalesce\n");
+#ifdef UNIMG_URING
+    if (x->img.mode == IMG_IO_URING) {
+        if (pl && x->gap >= 0) fprintf(x->log, "[io] io_uring keeps the order but does not coalesce\n");
+        if (extract_all_uring(x, n, at, src, pl ? pl->order : NULL) == 0) {
+            if (pl) plan_free(&plan);
+            return;
         }
+        fprintf(x->log, "[warn] io_uring is not available (%s), using kernel copies\n", strerror(errno));
+        x->img.mode = IMG_IO_KERNEL;
     }
-    out->count = w;
+#endif
+    size_t nw = jobs > 1 ? (size_t)jobs : 1;
+    size_t units = pl ? pl->nruns : n;
+    if (nw > units) nw = units;
+    if (nw <= 1 && !pl && !x->readahead) {
+        for (size_t i = 0; i < n; ++i) {
+            WrldHeader h;
+            at(src, i, &h);
+            extract_header(&h, i, x);
+        }
+        return;
+    }
+    if (nw > 1) fprintf(x->log, "[io] extracting with %zu workers\n", nw);
 
-    if (log) fprintf(log, "[scan] total slave headers: %zu\n", out->count);
+    ExtractPool p; memset(&p, 0, sizeof(p));
+    p.x = x; p.at = at; p.src = src; p.n = n;
+    p.plan = pl;
+    p.jobs = units;
+    p.logs = (StrBuf*)x->al->alloc(x->al, n * sizeof(StrBuf));
+    p.state = (unsigned char*)x->al->alloc(x->al, n);
+    memset(p.state, 0, n);
+    mutex_init(&p.mu);
+
+    ExtractWorker* ws = (ExtractWorker*)x->al->alloc(x->al, nw * sizeof(ExtractWorker));
+    thread_t* tids = (thread_t*)x->al->alloc(x->al, nw * sizeof(thread_t));
+    int* started = (int*)x->al->alloc(x->al, nw * sizeof(int));
+    for (size_t k = 0; k < nw; ++k) {
+        ws[k].pool = &p;
+        img_view(&x->img, &ws[k].img);
+    }
+    for (size_t k = 1; k < nw; ++k) started[k] = thread_start(&tids[k], extract_worker_main, &ws[k]) == 0;
+    extract_worker_main(&ws[0]);
+    for (size_t k = 1; k < nw; ++k) if (started[k]) thread_join(tids[k]);
+    for (size_t k = 0; k < nw; ++k) img_view_merge(&x->img, &ws[k].img);
+
+    mutex_destroy(&p.mu);
+    x->al->release(x->al, started); x->al->release(x->al, tids); x->al->release(x->al, ws);
+    x->al->release(x->al, p.state);
+    x->al->release(x->al, p.logs);
+    if (pl) plan_free(&plan);
 }
 
-/* copy IMG slice [start, end) to f, returns bytes written */
-static u64 copy_img_slice(FILE* img, u64 start, u64 end, FILE* f) {
-    const size_t CHUNK = 1u << 20; /* 1 MiB */
-    unsigned char* buf = (unsigned char*)xmalloc(CHUNK);
-    u64 left = (end > start) ? (end - start) : 0;
+/* header source for extract_all over a HeaderList */
+static void list_header_at(const void* src, size_t i, WrldHeader* h) {
+    *h = ((const HeaderList*)src)->items[i];
+}
+
+/* the whole LVZ, mapped read-only; an empty file gives an empty Blob */
+static void map_lvz(const char* lvz_path, Blob* out) {
+    u64 size = 0, mtime = 0;
+    if (blob_map(lvz_path, out) == 0) return;
+    if (file_stat(lvz_path, &size, &mtime) != 0 || size) die("Cannot open LVZ: %s", lvz_path);
+    out->data = NULL; out->len = 0; out->mapped = 0;
+}
+
+static void ignore_header(const WrldHeader* h, size_t idx, void* ctx) {
+    (void)h; (void)idx; (void)ctx;
+}
+
+/* load the access-point index, or build and save it with one streaming pass */
+static int zidx_open(ZIndex* zi, const char* lvz_path, const char* zidx_path, u64 span, FILE* log) {
+    u64 size = 0, mtime = 0;
+    if (file_stat(lvz_path, &size, &mtime) != 0) return -1;
+    if (zidx_load(zi, zidx_path, size, mtime) == 0) {
+        fprintf(log, "[zidx] loaded %zu access points from %s\n", zi->count, zidx_path);
+        return 0;
+    }
+    fprintf(log, "[zidx] no usable index at %s, building one\n", zidx_path);
+    zidx_init(zi, span, zi->al);
+    zi->lvz_size = size; zi->lvz_mtime = mtime;
+    HeaderList hl; header_list_init(&hl, zi->al);
+    u64 lvz_len = 0, decomp_len = 0; int starts_dlrw = 0;
+    int rc = stream_scan_lvz(lvz_path, &hl, ignore_header, NULL, zi, NULL,
+                             &lvz_len, &decomp_len, &starts_dlrw, NULL);
+    header_list_free(&hl);
+    if (rc != 0 || zi->count == 0) {
+        fprintf(log, "[error] LVZ stream is broken, no index built\n");
+        zidx_free(zi);
+        return -1;
+    }
+    if (zidx_save(zi, zidx_path) != 0)
+        fprintf(log, "[warn] cannot write %s (%s)\n", zidx_path, strerror(errno));
+    else
+        fprintf(log, "[zidx] wrote %zu access points (span %llu) to %s\n",
+                zi->count, (unsigned long long)zi->span, zidx_path);
+    return 0;
+}
+
+/* extract only the headers at the given LVZ offsets, decoding at most one
+   span per offset */
+static void extract_at(const ZIndex* zi, const char* lvz_path, const u64* offs, size_t n,
+                       ExtractCtx* xc) {
+    FILE* f = fopen(lvz_path, "rb");
+    if (!f) die("Cannot open LVZ: %s", lvz_path);
+    find_dlrw_fn find = scan_kernels()[0].fn;
+    for (size_t i = 0; i < n; ++i) {
+        u64 off = offs[i];
+        if (off + 32 > zi->decomp_len) {
+            fprintf(xc->log, "[warn] LVZ+0x%llX is past the decompressed end (%llu)\n",
+                    off, (unsigned long long)zi->decomp_len);
+            continue;
+        }
+        const ZPoint* p = zidx_point_for(zi, off);
+        if (!p) {
+            fprintf(xc->log, "[warn] no access point before LVZ+0x%llX\n", off);
+            continue;
+        }
+        size_t len = (size_t)(off + 32 - p->out);
+        uint8_t* buf = (uint8_t*)xmalloc(len);
+        long long got = zidx_read(zi, p, f, buf, len);
+        HeaderList hl; header_list_init(&hl, xc->al);
+        if (got == (long long)len) scan_range(buf, 0, len, len, find, p->out, &hl);
+        else fprintf(xc->log, "[warn] cannot decode LVZ+0x%llX from its access point\n", off);
+
+        size_t k = 0;
+        while (k < hl.count && hl.items[k].lvz_off < off) ++k;
+        if (k < hl.count && hl.items[k].lvz_off == off) {
+            fprintf(xc->log, "[zidx] LVZ+0x%llX: decoded %zu bytes from access point at 0x%llX\n",
+                    off, len, p->out);
+            extract_header(&hl.items[k], p->hdr_before + k, xc);
+        } else if (got == (long long)len) {
+            fprintf(xc->log, "[warn] no slave header at LVZ+0x%llX\n", off);
+        }
+        header_list_free(&hl);
+        free(buf);
+    }
+    fclose(f);
+}
+
+/* ---- header index sidecar ----
+   <out_dir>/<stem>.hidx holds every accepted header, so a repeat run over
+   an unchanged LVZ goes straight to extraction. Fixed 64-byte records (the
+   eight WrldHeader fields, then the raw header bytes), little-endian, read
+   in place through a mapping. */
+
+#define HIDX_MAGIC   "UHIX"
+#define HIDX_VERSION 1u
+#define HIDX_REC     64
+
+typedef struct {
+    u64 size, mtime;
+    uint32_t crc;
+} LvzKey;
+
+/* with chunked the file is read through a small buffer instead of being
+   mapped whole, so its pages do not count against --mem-budget */
+static int lvz_key(const char* path, LvzKey* k, int chunked) {
+    if (file_stat(path, &k->size, &k->mtime) != 0) return -1;
+    if (chunked) {
+        FILE* f = fopen(path, "rb");
+        if (!f) return -1;
+        uint8_t* buf = (uint8_t*)xmalloc(STREAM_IN_CHUNK);
+        uLong c = crc32(0, NULL, 0);
+        size_t got;
+        while ((got = fread(buf, 1, STREAM_IN_CHUNK, f)) > 0) c = crc32(c, buf, (uInt)got);
+        int err = ferror(f);
+        fclose(f); free(buf);
+        k->crc = (uint32_t)c;
+        return err ? -1 : 0;
+    }
+    size_t len = 0;
+    const uint8_t* p = map_file_ro(path, &len);
+    if (!p && k->size) return -1;
+    k->crc = crc32_all(p, len);
+    unmap_file(p, len);
+    return 0;
+}
+
+typedef struct {
+    const uint8_t* map;
+    size_t map_len;
+    size_t count;
+    LvzFormat fmt;
+    u64 decomp_len;
+} HeaderIndex;
+
+static int hidx_save(const char* path, const LvzKey* k, LvzFormat fmt, u64 decomp_len,
+                     HeaderList* hl) {
+    FILE* f = fopen(path, "wb");
+    if (!f) return -1;
+    uint8_t h[HIDX_REC]; memset(h, 0, sizeof(h));
+    memcpy(h, HIDX_MAGIC, 4);
+    put_u32le(h, 4, HIDX_VERSION);
+    put_u32le(h, 8, HIDX_REC);
+    put_u32le(h, 12, k->crc);
+    put_u64le(h, 16, k->size);
+    put_u64le(h, 24, k->mtime);
+    put_u64le(h, 32, decomp_len);
+    put_u64le(h, 40, header_list_total(hl));
+    put_u32le(h, 48, (uint32_t)fmt);
+    int ok = fwrite(h, 1, sizeof(h), f) == sizeof(h);
+    WrldHeader hw;
+    const WrldHeader* w = &hw;
+    for (size_t i = 0; ok && header_list_next(hl, &i, &hw);) {
+        uint8_t r[HIDX_REC];
+        put_u32le(r, 0, w->lvz_off);
+        put_u32le(r, 4, w->wrld_type);
+        put_u32le(r, 8, w->total_size);
+        put_u32le(r, 12, w->global0);
+        put_u32le(r, 16, w->global1);
+        put_u32le(r, 20, w->global_count);
+        put_u32le(r, 24, w->continuation);
+        put_u32le(r, 28, w->reserved);
+        memcpy(r + 32, w->raw, 32);
+        ok = fwrite(r, 1, sizeof(r), f) == sizeof(r);
+    }
+    if (fclose(f) != 0) ok = 0;
+    if (!ok) { remove(path); return -1; }
+    return 0;
+}
+
+/* 0 if path holds an index for an LVZ with this key */
+static int hidx_open(HeaderIndex* hx, const char* path, const LvzKey* k) {
+    memset(hx, 0, sizeof(*hx));
+    size_t len = 0;
+    const uint8_t* m = map_file_ro(path, &len);
+    if (!m) return -1;
+    int ok = len >= HIDX_REC
+          && memcmp(m, HIDX_MAGIC, 4) == 0
+          && read_u32le(m, 4) == HIDX_VERSION
+          && read_u32le(m, 8) == HIDX_REC
+          && read_u32le(m, 12) == k->crc
+          && read_u64le(m, 16) == k->size
+          && read_u64le(m, 24) == k->mtime
+          && read_u32le(m, 48) <= LVZ_RAW
+          && read_u64le(m, 40) == (len - HIDX_REC) / HIDX_REC
+          && (len - HIDX_REC) % HIDX_REC == 0;
+    if (!ok) { unmap_file(m, len); return -1; }
+    hx->map = m; hx->map_len = len;
+    hx->count = (size_t)read_u64le(m, 40);
+    hx->fmt = (LvzFormat)read_u32le(m, 48);
+    hx->decomp_len = read_u64le(m, 32);
+    return 0;
+}
+
+static WrldHeader hidx_header(const HeaderIndex* hx, size_t i) {
+    const uint8_t* r = hx->map + HIDX_REC + i * HIDX_REC;
+    WrldHeader h = { read_u32le(r, 0), read_u32le(r, 4), read_u32le(r, 8), read_u32le(r, 12),
+                     read_u32le(r, 16), read_u32le(r, 20), read_u32le(r, 24), read_u32le(r, 28), {0} };
+    memcpy(h.raw, r + 32, 32);
+    return h;
+}
+
+static void hidx_header_at(const void* src, size_t i, WrldHeader* h) {
+    *h = hidx_header((const HeaderIndex*)src, i);
+}
+
+static void hidx_close(HeaderIndex* hx) {
+    unmap_file(hx->map, hx->map_len);
+    hx->map = NULL;
+}
+
+static void save_hidx(const char* path, const LvzKey* k, LvzFormat fmt, u64 decomp_len,
+                      HeaderList* hl, FILE* log) {
+    if (hidx_save(path, k, fmt, decomp_len, hl) != 0)
+        fprintf(log, "[warn] cannot write %s (%s)\n", path, strerror(errno));
+    else
+        fprintf(log, "[hidx] wrote %zu headers to %s\n", header_list_total(hl), path);
+}
+
+/* ---- decompressed LVZ cache ----
+   --cache-dir holds the inflated bytes of each LVZ as a plain file named
+   after the input's size, CRC-32 and Adler-32, so other tools can map the
+   same file. Entries are written to a private temp file and renamed into
+   place, so readers only ever see complete files. A hit refreshes the
+   entry's mtime, and eviction drops the oldest entries under an exclusive
+   lock on <dir>/.lock until the total fits --cache-max. */
+
+#define CACHE_DEFAULT_MAX (2048ull << 20)
+#define CACHE_EXT         ".lvzd"
+#define CACHE_TMP_AGE     3600      /* seconds before a stray temp file is removed */
+
+static void cache_entry_path(const char* dir, const uint8_t* in, size_t in_len,
+                             char* out, size_t outsz) {
+    char name[64];
+    snprintf(name, sizeof(name), "%016llx-%08x-%08x" CACHE_EXT, (unsigned long long)in_len,
+             (unsigned)crc32_all(in, in_len), (unsigned)adler32_all(in, in_len));
+    path_join(out, outsz, dir, name);
+}
+
+static void touch_file(const char* path) {
 #ifdef _WIN32
-    _fseeki64(img, (long long)start, SEEK_SET);
+    _utime(path, NULL);
 #else
-    fseeko(img, (off_t)start, SEEK_SET);
+    utime(path, NULL);
 #endif
-    u64 total = 0;
-    while (left) {
-        size_t want = (left > CHUNK) ? CHUNK : (size_t)left;
-        size_t got = fread(buf, 1, want, img);
-        if (got == 0) break;
-        fwrite(buf, 1, got, f);
-        left -= got; total += got;
-        if (got < want) break; /* reached EOF earlier than expected */
+}
+
+static int cache_get(const char* path, Blob* out) {
+    if (blob_map(path, out) != 0) return -1;
+    touch_file(path);
+    return 0;
+}
+
+#ifdef _WIN32
+typedef HANDLE dir_lock_t;
+#else
+typedef int dir_lock_t;
+#endif
+
+static int dir_lock(const char* dir, dir_lock_t* l) {
+    char path[1200]; path_join(path, sizeof(path), dir, ".lock");
+#ifdef _WIN32
+    *l = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                     NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (*l == INVALID_HANDLE_VALUE) return -1;
+    OVERLAPPED ov; memset(&ov, 0, sizeof(ov));
+    if (!LockFileEx(*l, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &ov)) { CloseHandle(*l); return -1; }
+#else
+    *l = open(path, O_RDWR | O_CREAT, 0644);
+    if (*l < 0) return -1;
+    if (flock(*l, LOCK_EX) != 0) { close(*l); return -1; }
+#endif
+    return 0;
+}
+
+static void dir_unlock(dir_lock_t l) {
+#ifdef _WIN32
+    OVERLAPPED ov; memset(&ov, 0, sizeof(ov));
+    UnlockFileEx(l, 0, 1, 0, &ov);
+    CloseHandle(l);
+#else
+    flock(l, LOCK_UN);
+    close(l);
+#endif
+}
+
+typedef struct {
+    char name[64];
+    u64 size, mtime;
+    int tmp;
+} CacheEntry;
+
+static int cmp_by_mtime(const void* a, const void* b) {
+    const CacheEntry* x = (const CacheEntry*)a;
+    const CacheEntry* y = (const CacheEntry*)b;
+    if (x->mtime < y->mtime) return -1;
+    if (x->mtime > y->mtime) return 1;
+    return 0;
+}
+
+static void cache_list_add(CacheEntry** es, size_t* n, const char* dir, const char* name) {
+    size_t nl = strlen(name), el = strlen(CACHE_EXT);
+    int tmp = strncmp(name, ".tmp-", 5) == 0;
+    if (nl >= sizeof((*es)->name)) return;
+    if (!tmp && (nl <= el || strcmp(name + nl - el, CACHE_EXT) != 0)) return;
+    char path[1200]; path_join(path, sizeof(path), dir, name);
+    CacheEntry e; memset(&e, 0, sizeof(e));
+    if (file_stat(path, &e.size, &e.mtime) != 0) return;
+    memcpy(e.name, name, nl + 1);
+    e.tmp = tmp;
+    *es = (CacheEntry*)xrealloc(*es, (*n + 1) * sizeof(CacheEntry));
+    (*es)[(*n)++] = e;
+}
+
+static CacheEntry* cache_list(const char* dir, size_t* n) {
+    CacheEntry* es = NULL; *n = 0;
+#ifdef _WIN32
+    char pat[1200]; path_join(pat, sizeof(pat), dir, "*");
+    WIN32_FIND_DATAA fd;
+    HANDLE h = FindFirstFileA(pat, &fd);
+    if (h == INVALID_HANDLE_VALUE) return NULL;
+    do cache_list_add(&es, n, dir, fd.cFileName); while (FindNextFileA(h, &fd));
+    FindClose(h);
+#else
+    DIR* d = opendir(dir);
+    if (!d) return NULL;
+    for (struct dirent* de; (de = readdir(d)) != NULL; ) cache_list_add(&es, n, dir, de->d_name);
+    closedir(d);
+#endif
+    return es;
+}
+
+/* drop the least recently used entries until the cache fits max; keep is
+   never removed. Returns the number of files removed. */
+static size_t cache_evict(const char* dir, u64 max, const char* keep) {
+    dir_lock_t l;
+    if (dir_lock(dir, &l) != 0) return 0;
+    size_t n = 0, removed = 0;
+    CacheEntry* es = cache_list(dir, &n);
+    qsort(es, n, sizeof(CacheEntry), cmp_by_mtime);
+    u64 total = 0, now = (u64)time(NULL);
+    for (size_t i = 0; i < n; ++i) if (!es[i].tmp) total += es[i].size;
+    for (size_t i = 0; i < n; ++i) {
+        char path[1200]; path_join(path, sizeof(path), dir, es[i].name);
+        if (es[i].tmp) {
+            /* leftovers of a writer that died; live ones are much younger */
+            if (es[i].mtime + CACHE_TMP_AGE < now && remove(path) == 0) ++removed;
+            continue;
+        }
+        if (total <= max) continue;
+        if (strcmp(path, keep) == 0) continue;
+        if (remove(path) == 0) { total -= es[i].size; ++removed; }
     }
-    free(buf);
-    return total;
+    free(es);
+    dir_unlock(l);
+    return removed;
 }
 
-static int write_wrld(const WrldHeader* h, const uint8_t* decomp_lvz,
-                      FILE* img, u64 img_size,
-                      const char* out_path, FILE* log) {
-    FILE* f = fopen(out_path, "wb");
-    if (!f) {
-        if (log) fprintf(log, "[error] cannot write %s (%s)\n", out_path, strerror(errno));
-        return -1;
+static int cache_put(const char* dir, const char* path, const SegBuf* d) {
+    static unsigned seq;
+    char name[96], tmp[1200];
+#ifdef _WIN32
+    snprintf(name, sizeof(name), ".tmp-%lu-%u", (unsigned long)GetCurrentProcessId(), seq++);
+#else
+    snprintf(name, sizeof(name), ".tmp-%ld-%u", (long)getpid(), seq++);
+#endif
+    path_join(tmp, sizeof(tmp), dir, name);
+    FILE* f = fopen(tmp, "wb");
+    if (!f) return -1;
+    int ok = 1;
+    for (size_t k = 0; ok && k < d->nseg; ++k)
+        ok = fwrite(d->seg[k].p, 1, d->seg[k].len, f) == d->seg[k].len;
+    if (fclose(f) != 0) ok = 0;
+#ifdef _WIN32
+    if (ok) ok = MoveFileExA(tmp, path, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    if (ok) ok = rename(tmp, path) == 0;
+#endif
+    if (!ok) { remove(tmp); return -1; }
+    return 0;
+}
+
+/* run every available DLRW kernel over the decompressed LVZ and report GB/s */
+static int bench_scan(const char* lvz_path, int threads) {
+    Blob lvz;
+    SegBuf decomp;
+    map_lvz(lvz_path, &lvz);
+    maybe_decompress_lvz(&lvz, &inflate_backends[0], 0, 0, &decomp, NULL);
+    blob_release(&lvz);
+    size_t n = decomp.len;
+    printf("bench-scan: %s (%zu bytes decompressed; huge pages: %s)\n", lvz_path, n,
+           huge_mode_name(huge.mode));
+
+    /* enough passes to cover ~2 GiB, at least 3 */
+    int reps = n ? (int)((2ull << 30) / n) : 1;
+    if (reps < 3) reps = 3;
+
+    size_t ref_hits = 0; u64 ref_sum = 0; int first = 1, rc = 0;
+    for (const ScanKernel* k = scan_kernels(); k->name; ++k) {
+        size_t hits = 0; u64 sum = 0;
+        double best = 0;
+        for (int r = 0; r < reps; ++r) {
+            double t0 = now_sec();
+            size_t c = 0; u64 s = 0;
+            for (size_t g = 0; g < decomp.nseg; ++g) {
+                const uint8_t* d = decomp.seg[g].p;
+                size_t len = decomp.seg[g].len, j = 0;
+                while ((j = k->fn(d, j, len)) < len) { ++c; s += j; j += 4; }
+            }
+            double dt = now_sec() - t0;
+            if (r == 0 || dt < best) best = dt;
+            hits = c; sum = s;
+        }
+        double gbs = best > 0 ? (double)n / best / 1e9 : 0;
+        printf("  %-7s %8.2f GB/s  (%zu signatures)\n", k->name, gbs, hits);
+        if (first) { ref_hits = hits; ref_sum = sum; first = 0; }
+        else if (hits != ref_hits || sum != ref_sum) {
+            printf("  %-7s MISMATCH against %s\n", k->name, scan_kernels()[0].name);
+            rc = 1;
+        }
     }
-    /* header */
-    if (fwrite(decomp_lvz + h->lvz_off, 1, 32, f) != 32) {
-        if (log) fprintf(log, "[error] write header failed for %s\n", out_path);
-        fclose(f);
-        return -2;
+
+    /* full header scan, single-threaded vs partitioned */
+    int tmax = threads > 0 ? threads : cpu_count();
+    size_t ref_count = 0;
+    for (int t = 1; ; t = (t * 2 > tmax) ? tmax : t * 2) {
+        double best = 0; HeaderList hl;
+        for (int r = 0; r < reps; ++r) {
+            double t0 = now_sec();
+            header_list_init(&hl, &sys_alloc);
+            scan_slave_headers(&decomp, t, &hl, NULL);
+            double dt = now_sec() - t0;
+            if (r == 0 || dt < best) best = dt;
+            if (r + 1 < reps) header_list_free(&hl);
+        }
+        if (t == 1) ref_count = hl.count;
+        printf("  scan -t %-3d %6.2f GB/s  (%zu headers)%s\n", t,
+               best > 0 ? (double)n / best / 1e9 : 0, hl.count,
+               hl.count == ref_count ? "" : "  MISMATCH");
+        if (hl.count != ref_count) rc = 1;
+        header_list_free(&hl);
+        if (t >= tmax) break;
     }
+    segbuf_free(&decomp);
+    return rc;
+}
 
-    /* body */
-    u64 start = (u64)h->continuation;
-    u64 need  = (h->total_size >= 32) ? ((u64)h->total_size - 32ull) : 0ull;
-    u64 end   = start + need;
-    if (start > img_size) {
-        if (log) fprintf(log, "[warn] continuation start beyond IMG (%llu > %llu); writing header only\n",
-                         (unsigned long long)start, (unsigned long long)img_size);
-        fclose(f);
-        return 0;
+/* best of five decodes, in seconds; -1 if the backend fails */
+static double time_inflate(const InflateBackend* b, InflateJob* job, LvzFormat fmt,
+                           const uint8_t* in, size_t in_len) {
+    double best = -1;
+    for (int r = 0; r < 5; ++r) {
+        SegBuf d;
+        double t0 = now_sec();
+        job->note[0] = 0;
+        if (b->decode(job, fmt, in, in_len, &d) != 0) return -1;
+        double dt = now_sec() - t0;
+        segbuf_free(&d);
+        if (best < 0 || dt < best) best = dt;
     }
-    if (end > img_size) {
-        if (log) fprintf(log, "[warn] continuation clipped (%llu -> %llu)\n",
-                         (unsigned long long)end, (unsigned long long)img_size);
-        end = img_size;
+    return best;
+}
+
+/* streams with no dynamic blocks give the parallel backend nothing to
+   split on: re-encode the data with only fixed and only stored blocks and
+   check that its bounded search leaves it within 25% (or 20 ms) of serial */
+static int bench_parallel_fallback(const SegBuf* data, InflateJob* job) {
+    static const struct { const char* name; int level, strategy; } kinds[] = {
+        { "fixed-only", 6, Z_FIXED }, { "stored-only", 0, Z_DEFAULT_STRATEGY } };
+    const InflateBackend* serial = find_inflate_backend("builtin");
+    const InflateBackend* par = find_inflate_backend("parallel");
+    int rc = 0;
+    for (size_t k = 0; k < sizeof(kinds) / sizeof(kinds[0]); ++k) {
+        z_stream zs; memset(&zs, 0, sizeof(zs));
+        if (deflateInit2(&zs, kinds[k].level, Z_DEFLATED, 15, 8, kinds[k].strategy) != Z_OK)
+            die("deflateInit2 failed");
+        size_t cap = (size_t)deflateBound(&zs, (uLong)data->len), len = 0;
+        uint8_t* enc = (uint8_t*)big_alloc(cap);
+        zs.next_out = enc; zs.avail_out = (uInt)cap;
+        for (size_t g = 0; g < data->nseg; ++g) {
+            zs.next_in = data->seg[g].p; zs.avail_in = (uInt)data->seg[g].len;
+            deflate(&zs, Z_NO_FLUSH);
+        }
+        deflate(&zs, Z_FINISH);
+        len = cap - zs.avail_out;
+        deflateEnd(&zs);
+
+        job->size_hint = 0;
+        double ts = time_inflate(serial, job, LVZ_ZLIB, enc, len);
+        double tp = time_inflate(par, job, LVZ_ZLIB, enc, len);
+        int slow = ts < 0 || tp < 0 || tp > ts * 1.25 + 0.020;
+        printf("  %-11s builtin %7.1f ms  parallel %7.1f ms  %s%s\n", kinds[k].name,
+               ts * 1e3, tp * 1e3, job->note, slow ? "  SLOW" : "");
+        if (slow) rc = 1;
+        big_free(enc);
     }
+    return rc;
+}
 
-    u64 body = copy_img_slice(img, start, end, f);
-    if (log) fprintf(log, "[build] %s header=32 body=%llu total_out=%llu (expected %u)\n",
-                     out_path, (unsigned long long)body,
-                     (unsigned long long)(32ull + body), h->total_size);
-    fclose(f);
-    return 0;
+/* decode the LVZ with every inflate backend and compare speed and output */
+static int bench_inflate(const char* lvz_path, int threads) {
+    Blob lvz;
+    map_lvz(lvz_path, &lvz);
+    const uint8_t* in = lvz.data;
+    size_t in_len = lvz.len;
+    z_stream strm; memset(&strm, 0, sizeof(strm));
+    if (inflateInit2(&strm, -15) != Z_OK) die("inflateInit2 failed");
+    LvzFormat fmt = detect_lvz_format(&strm, in, in_len);
+    printf("bench-inflate: %s (%zu bytes, %s)\n", lvz_path, in_len, lvz_format_name(fmt));
+    if (fmt == LVZ_STORED) {
+        printf("  nothing to inflate\n");
+        inflateEnd(&strm); blob_release(&lvz);
+        return 0;
+    }
+    InflateJob job; memset(&job, 0, sizeof(job));
+    job.strm = &strm;
+    job.size_hint = fmt == LVZ_GZIP ? gzip_isize(in, in_len) : 0;
+    job.threads = threads;
+
+    SegBuf ref; segbuf_init(&ref);
+    int have_ref = 0, rc = 0;
+    for (const InflateBackend* b = inflate_backends; b->name; ++b) {
+        double best = 0; SegBuf d; int ok = 1;
+        for (int r = 0; r < 5 && ok; ++r) {
+            double t0 = now_sec();
+            job.note[0] = 0;
+            ok = b->decode(&job, fmt, in, in_len, &d) == 0;
+            double dt = now_sec() - t0;
+            if (r == 0 || dt < best) best = dt;
+            if (ok && r < 4) segbuf_free(&d);
+        }
+        if (!ok) { printf("  %-10s FAILED\n", b->name); rc = 1; continue; }
+        printf("  %-10s %8.1f MB/s out  %8.1f MB/s in  (%zu bytes", b->name,
+               best > 0 ? (double)d.len / best / 1e6 : 0, best > 0 ? (double)in_len / best / 1e6 : 0, d.len);
+        if (d.nseg > 1) printf(" in %zu segments", d.nseg);
+        printf(")");
+        if (job.note[0]) printf(" %s", job.note);
+        if (!have_ref) { ref = d; have_ref = 1; printf("\n"); continue; }
+        int same = segbuf_same(&d, &ref);
+        printf("%s\n", same ? "" : "  MISMATCH");
+        if (!same) rc = 1;
+        segbuf_free(&d);
+    }
+    if (have_ref && bench_parallel_fallback(&ref, &job) != 0) rc = 1;
+    segbuf_free(&ref);
+    inflateEnd(&strm);
+    blob_release(&lvz);
+    return rc;
 }
 
-static void banner(void) {
-    fprintf(stderr, "=== unIMG 2 Stories IMG Extractor ===\n");
-    fprintf(stderr, "Usage: unimg <path-to>.lvz\n\n");
+/* time each extraction path over the same headers, writing into
+   <out_dir>/bench-extract; the IMG is read once up front so every path
+   starts from a warm page cache */
+static int bench_extract(const char* lvz_path, int jobs, unsigned qd, int plan, long long gap) {
+    char img_path[1024]; derive_img_path(lvz_path, img_path, sizeof(img_path));
+    Blob lvz;
+    SegBuf decomp;
+    map_lvz(lvz_path, &lvz);
+    maybe_decompress_lvz(&lvz, &inflate_backends[0], 0, 0, &decomp, NULL);
+    blob_release(&lvz);
+    HeaderList hl; header_list_init(&hl, &sys_alloc);
+    scan_slave_headers(&decomp, 0, &hl, NULL);
+    segbuf_free(&decomp);
+
+    ImgSource warm;
+    if (img_open(&warm, img_path, IMG_IO_STDIO) != 0) {
+        fprintf(stderr, "ERROR: cannot open IMG %s\n", img_path);
+        header_list_free(&hl);
+        return 2;
+    }
+    u64 img_size = warm.size, body_bytes = 0;
+    for (u64 off = 0; off < img_size; off += buf_pool.size) pread_full(warm.f, warm.buf, buf_pool.size, off);
+    img_close(&warm);
+    StrBuf quiet = { NULL, 0, 0, NULL };
+    for (size_t i = 0; i < hl.count; ++i) {
+        u64 a, b;
+        if (wrld_body_range(&hl.items[i], img_size, &a, &b, &quiet) == 0) body_bytes += b - a;
+        quiet.len = 0;
+    }
+    sb_free(&quiet);
+
+    char out_dir[1024]; out_dir_default(lvz_path, out_dir, sizeof(out_dir));
+    make_dir_if_needed(out_dir);
+    char bench_dir[1100]; path_join(bench_dir, sizeof(bench_dir), out_dir, "bench-extract");
+    make_dir_if_needed(bench_dir);
+#ifdef _WIN32
+    FILE* sink = fopen("NUL", "w");
+#else
+    FILE* sink = fopen("/dev/null", "w");
+#endif
+    if (!sink) die("Cannot open the null device");
+    int nj = jobs > 1 ? jobs : cpu_count();
+    printf("bench-extract: %s (%zu WRLDs, %.1f MB of bodies; huge pages: %s)\n", lvz_path, hl.count,
+           (double)body_bytes / 1e6, huge_mode_name(huge.mode));
+
+    static const struct { const char* name; ImgIoMode mode; int pool; } cfg[] = {
+        { "stdio",  IMG_IO_STDIO,  0 },
+        { "mmap",   IMG_IO_MMAP,   0 },
+        { "kernel", IMG_IO_KERNEL, 0 },
+        { "kernel", IMG_IO_KERNEL, 1 },
+        { "uring",  IMG_IO_URING,  0 },
+        { "direct", IMG_IO_DIRECT, 0 },
+    };
+    int rc = 0;
+    size_t ref_written = 0;
+    for (size_t c = 0; c < sizeof(cfg) / sizeof(cfg[0]); ++c) {
+        ExtractCtx xc; memset(&xc, 0, sizeof(xc));
+        xc.out_dir = bench_dir;
+        xc.log = sink;
+        xc.al = &sys_alloc;
+        xc.qd = qd;
+        xc.plan = plan;
+        xc.gap = plan ? gap : -1;
+        if (img_open(&xc.img, img_path, cfg[c].mode) != 0) die("Cannot open IMG: %s", img_path);
+        double t0 = now_sec();
+        extract_all(&xc, hl.count, list_header_at, &hl, cfg[c].pool ? nj : 1);
+        double dt = now_sec() - t0;
+
+        char label[64];
+        if (cfg[c].pool) snprintf(label, sizeof(label), "%s -j %d", cfg[c].name, nj);
+        else if (cfg[c].mode == IMG_IO_URING) snprintf(label, sizeof(label), "%s qd %u", cfg[c].name,
+                                                        qd ? qd : URING_QD_DEFAULT);
+        else snprintf(label, sizeof(label), "%s", cfg[c].name);
+        printf("  %-14s %8.1f MB/s  %8.0f files/s", label,
+               dt > 0 ? (double)body_bytes / dt / 1e6 : 0, dt > 0 ? (double)hl.count / dt : 0);
+        if (xc.img.mode != cfg[c].mode) printf("  (ran as %s)", img_io_name(xc.img.mode));
+        if (c == 0) ref_written = xc.written;
+        else if (xc.written != ref_written) { printf("  MISMATCH (%zu written)", xc.written); rc = 1; }
+        printf("\n");
+        img_close(&xc.img);
+        sb_free(&xc.sb);
+
+        for (size_t i = 0; i < hl.count; ++i) {
+            char name[256], path[1400];
+            wrld_name(&xc, i, name, sizeof(name), path, sizeof(path));
+            remove(path);
+        }
+    }
+    fclose(sink);
+    header_list_free(&hl);
+    return rc;
 }
 
-int main(int argc, char** argv) {
-    if (argc != 2) {
-        banner();
-        return 1;
+/* --mem-budget on the hidx path: a quarter of the budget for copy buffers
+   (each worker holds a chunk, a read-ahead chunk and an O_DIRECT stage) and
+   a quarter for the per-header plan and log tables. Returns the jobs to use. */
+static int mem_fit_pool(ExtractCtx* x, size_t n, int jobs, u64 budget, size_t chunk) {
+    u64 share = budget / 4;
+    u64 per_job = 3 * (u64)chunk;
+    int nj = jobs;
+    if (nj > 1 && (u64)nj * per_job > share) nj = share / per_job > 1 ? (int)(share / per_job) : 1;
+    if ((u64)n * MEM_PER_HEADER > share && (x->plan || nj > 1 || x->readahead)) {
+        fprintf(x->log, "[mem] %zu headers: plan and worker tables would not fit, extracting serially "
+                "in header order\n", n);
+        x->plan = 0; x->gap = -1; x->readahead = 0;
+        nj = 1;
     }
+    if (nj != jobs) fprintf(x->log, "[mem] -j %d -> %d\n", jobs, nj);
+    return nj;
+}
+
+/* command-line settings shared by every LVZ of a run */
+typedef struct {
+    int threads, jobs;
+    unsigned qd, qd_req;         /* qd after --mem-budget, and as asked */
+    int plan;
+    long long coalesce_gap;
+    size_t chunk_size, chunk_req;
+    unsigned readahead;
+    int drop_cache;
+    u64 mem_budget;
+    int stream, size_prepass, save_zidx;
+    int use_index, rebuild_index;
+    const char* cache_dir;
+    ImgIoMode img_io;
+    u64 cache_max, zran_span;
+    const u64* at; size_t at_count;
+    const InflateBackend* backend;
+    int batch;                   /* several LVZs: each gets out_wrld/<stem> */
+} Options;
 
-    const char* lvz_path = argv[1];
+/* one LVZ from start to finish; returns the process exit code. al serves
+   the per-file tables and is reset by the caller afterwards. */
+static int extract_lvz(const char* lvz_path, const Options* opt, Arena* arena) {
+    int threads = opt->threads, jobs = opt->jobs;
+    unsigned qd = opt->qd, qd_req = opt->qd_req;
+    int plan = opt->plan;
+    long long coalesce_gap = opt->coalesce_gap;
+    size_t chunk_size = opt->chunk_size, chunk_req = opt->chunk_req;
+    unsigned readahead = opt->readahead;
+    int drop_cache = opt->drop_cache;
+    u64 mem_budget = opt->mem_budget;
+    int stream = opt->stream, size_prepass = opt->size_prepass, save_zidx = opt->save_zidx;
+    int use_index = opt->use_index, rebuild_index = opt->rebuild_index;
+    const char* cache_dir = opt->cache_dir;
+    ImgIoMode img_io = opt->img_io;
+    u64 cache_max = opt->cache_max, zran_span = opt->zran_span;
+    const u64* at = opt->at; size_t at_count = opt->at_count;
+    const InflateBackend* backend = opt->backend;
+    Alloc* al = arena ? &arena->base : &sys_alloc;
 
     /* derive IMG and out_dir */
     char img_path[1024]; derive_img_path(lvz_path, img_path, sizeof(img_path));
@@ -370,6 +4522,12 @@ int main(int argc, char** argv) {
         return 2;
     }
     char out_dir[1024]; out_dir_default(lvz_path, out_dir, sizeof(out_dir));
+    if (opt->batch) {
+        char stem[512]; path_stem(lvz_path, stem, sizeof(stem));
+        make_dir_if_needed(out_dir);
+        size_t n = strlen(out_dir);
+        snprintf(out_dir + n, sizeof(out_dir) - n, "%c%s", path_sep, stem);
+    }
     make_dir_if_needed(out_dir);
 
     /* open log */
@@ -385,74 +4543,462 @@ int main(int argc, char** argv) {
     fprintf(log, "IMG: %s\n", img_path);
     fprintf(log, "Out: %s\n\n", out_dir);
 
-    /* read LVZ into memory */
-    FILE* flvz = fopen(lvz_path, "rb");
-    if (!flvz) die("Cannot open LVZ: %s", lvz_path);
-    fseek(flvz, 0, SEEK_END);
-    long lvz_len_l = ftell(flvz);
-    if (lvz_len_l < 0) die("ftell failed on LVZ");
-    size_t lvz_len = (size_t)lvz_len_l;
-    fseek(flvz, 0, SEEK_SET);
-    uint8_t* lvz_raw = (uint8_t*)xmalloc(lvz_len);
-    if (fread(lvz_raw, 1, lvz_len, flvz) != lvz_len) die("Failed to read LVZ");
-    fclose(flvz);
-
-    /* decompress if possible */
-    uint8_t* decomp = NULL; size_t decomp_len = 0;
-    maybe_decompress_lvz(lvz_raw, lvz_len, &decomp, &decomp_len);
-    free(lvz_raw);
-    fprintf(log, "[io] LVZ bytes: %zu; decompressed: %zu\n", lvz_len, decomp_len);
-    if (decomp_len < 32) {
-        fprintf(log, "[error] decompressed stream too small\n");
-        fclose(log);
-        free(decomp);
-        return 3;
-    }
-    if (!(decomp[0]=='D'&&decomp[1]=='L'&&decomp[2]=='R'&&decomp[3]=='W')) {
-        fprintf(log, "[warn] decompressed data does not start with DLRW, scanning anyway\n");
-    }
-
-    /* scan headers */
-    HeaderList headers; scan_slave_headers(decomp, decomp_len, &headers, log);
-    if (headers.count == 0) {
-        fprintf(stderr, "No slave WRLD headers found.\n");
-        fprintf(log, "[error] no slave headers\n");
-        fclose(log);
-        free(decomp);
-        return 4;
-    }
-
-    /* open IMG for streaming, get size */
-    FILE* fimg = fopen(img_path, "rb");
-    if (!fimg) {
-        fprintf(log, "[error] cannot open IMG\n");
-        fclose(log);
-        free(decomp);
-        return 5;
-    }
-    fseek64(fimg, 0, SEEK_END);
-    u64 img_size = (u64)ftell64(fimg);
-    fseek64(fimg, 0, SEEK_SET);
-    fprintf(log, "[io] IMG bytes: %llu\n\n", (unsigned long long)img_size);
-
-    /* write each WRLD */
-    size_t written = 0;
-    for (size_t i = 0; i < headers.count; ++i) {
-        char name[256];
-        snprintf(name, sizeof(name), "wrld_%04zu.wrld", i);
-        char out_path[1400]; path_join(out_path, sizeof(out_path), out_dir, name);
-        int rc = write_wrld(&headers.items[i], decomp, fimg, img_size, out_path, log);
-        if (rc == 0) ++written;
-        else fprintf(log, "[warn] failed to write %s (rc=%d)\n", name, rc);
-    }
-
-    fprintf(log, "\n[done] wrote %zu WRLD files to %s\n", written, out_dir);
-    fclose(fimg);
+    ExtractCtx xc; memset(&xc, 0, sizeof(xc));
+    xc.out_dir = out_dir;
+    xc.log = log;
+    xc.qd = qd;
+    xc.plan = plan;
+    xc.gap = plan ? coalesce_gap : -1;
+    xc.readahead = readahead;
+    xc.drop_cache = drop_cache;
+    xc.al = al;
+    xc.sb.al = al;
+    HeaderList headers;
+    header_list_init(&headers, al);
+
+    char stem[512]; path_stem(lvz_path, stem, sizeof(stem));
+    char zidx_name[600]; snprintf(zidx_name, sizeof(zidx_name), "%s.zidx", stem);
+    char zidx_path[1700]; path_join(zidx_path, sizeof(zidx_path), out_dir, zidx_name);
+    ZIndex zi; zidx_init(&zi, zran_span, al);
+    char hidx_name[600]; snprintf(hidx_name, sizeof(hidx_name), "%s.hidx", stem);
+    char hidx_path[1700]; path_join(hidx_path, sizeof(hidx_path), out_dir, hidx_name);
+    LvzKey key;
+    int have_key = use_index && !at_count && lvz_key(lvz_path, &key, mem_budget != 0) == 0;
+    HeaderIndex hx;
+    if (mem_budget) {
+        /* every stage sized to the budget; only the hidx fast path is
+           decided later, once the header count is known */
+        fprintf(log, "[mem] budget %llu MiB\n", (unsigned long long)(mem_budget >> 20));
+        if (!stream && !at_count) {
+            fprintf(log, "[mem] streaming the LVZ in %u KiB reads and %u KiB inflate chunks\n",
+                    STREAM_IN_CHUNK >> 10, STREAM_OUT_CHUNK >> 10);
+            stream = 1;
+        }
+        if (cache_dir) {
+            fprintf(log, "[mem] --cache-dir ignored: a cache entry is the whole inflated LVZ\n");
+            cache_dir = NULL;
+        }
+        if (img_io == IMG_IO_MMAP) {
+            fprintf(log, "[mem] --io mmap would map the whole IMG, using kernel\n");
+            img_io = IMG_IO_KERNEL;
+        }
+        if (chunk_size != chunk_req)
+            fprintf(log, "[mem] copy chunk %zu -> %zu KiB\n", chunk_req >> 10, chunk_size >> 10);
+        if (img_io == IMG_IO_URING && qd && qd != qd_req)
+            fprintf(log, "[mem] io_uring queue depth %u -> %u\n", qd_req, qd);
+        fprintf(log, "[mem] header list spills to a temporary file past %zu entries\n", header_list_max);
+    }
+    if (save_zidx && !stream) {
+        fprintf(log, "[zidx] indexing needs the streaming inflate, enabling --stream\n");
+        stream = 1;
+    }
+
+    if (at_count) {
+        if (img_open(&xc.img, img_path, img_io) != 0) {
+            fprintf(log, "[error] cannot open IMG\n");
+            fclose(log);
+            return 5;
+        }
+        fprintf(log, "[io] IMG bytes: %llu; io: %s\n", (unsigned long long)xc.img.size,
+                img_io_name(xc.img.mode));
+        if (zidx_open(&zi, lvz_path, zidx_path, zran_span, log) != 0) {
+            img_close(&xc.img); fclose(log);
+            return 3;
+        }
+        fprintf(log, "[io] LVZ format: %s; decompressed: %llu\n\n", lvz_format_name(zi.fmt),
+                (unsigned long long)zi.decomp_len);
+        extract_at(&zi, lvz_path, at, at_count, &xc);
+        zidx_free(&zi);
+    } else if (have_key && !rebuild_index && !save_zidx && hidx_open(&hx, hidx_path, &key) == 0) {
+        /* unchanged LVZ: no inflate, no scan */
+        if (img_open(&xc.img, img_path, img_io) != 0) {
+            fprintf(log, "[error] cannot open IMG\n");
+            hidx_close(&hx);
+            fclose(log);
+            return 5;
+        }
+        fprintf(log, "[hidx] %zu headers from %s; skipping inflate and scan\n", hx.count, hidx_path);
+        fprintf(log, "[io] LVZ format: %s\n", lvz_format_name(hx.fmt));
+        fprintf(log, "[io] LVZ bytes: %llu; decompressed: %llu\n",
+                (unsigned long long)key.size, (unsigned long long)hx.decomp_len);
+        fprintf(log, "[scan] total slave headers: %zu\n", hx.count);
+        fprintf(log, "[io] IMG bytes: %llu; io: %s\n\n", (unsigned long long)xc.img.size,
+                img_io_name(xc.img.mode));
+        xc.log_scan = 1;
+        if (mem_budget) jobs = mem_fit_pool(&xc, hx.count, jobs, mem_budget, chunk_size);
+        extract_all(&xc, hx.count, hidx_header_at, &hx, jobs);
+        hidx_close(&hx);
+    } else if (stream) {
+        /* IMG first, so bodies can be written while the LVZ is still inflating */
+        if (img_open(&xc.img, img_path, img_io) != 0) {
+            fprintf(log, "[error] cannot open IMG\n");
+            fclose(log);
+            return 5;
+        }
+        fprintf(log, "[io] IMG bytes: %llu; io: %s\n", (unsigned long long)xc.img.size,
+                img_io_name(xc.img.mode));
+        xc.log_scan = 1;
+        if (mem_budget && jobs > 1) fprintf(log, "[mem] -j %d unused: streaming extraction is serial\n", jobs);
+
+        u64 lvz_len = 0, decomp_len = 0; int starts_dlrw = 0;
+        u64 fsize = 0, fmtime = 0;
+        int indexing = save_zidx && file_stat(lvz_path, &fsize, &fmtime) == 0;
+        zi.lvz_size = fsize; zi.lvz_mtime = fmtime;
+        LvzFormat fmt = LVZ_STORED;
+        int src = stream_scan_lvz(lvz_path, &headers, extract_header, &xc, indexing ? &zi : NULL,
+                                  &fmt, &lvz_len, &decomp_len, &starts_dlrw, log);
+        if (indexing && src == 0) {
+            if (zidx_save(&zi, zidx_path) != 0)
+                fprintf(log, "[warn] cannot write %s (%s)\n", zidx_path, strerror(errno));
+            else
+                fprintf(log, "[zidx] wrote %zu access points (span %llu) to %s\n",
+                        zi.count, (unsigned long long)zi.span, zidx_path);
+        }
+        zidx_free(&zi);
+        fprintf(log, "[io] LVZ bytes: %llu; decompressed: %llu\n",
+                (unsigned long long)lvz_len, (unsigned long long)decomp_len);
+        fprintf(log, "[scan] total slave headers: %zu\n", header_list_total(&headers));
+        if (headers.spilled)
+            fprintf(log, "[mem] spilled %zu headers to a temporary file\n", headers.spilled);
+        if (src != 0) {
+            /* bodies were written as headers were found; say the set is partial */
+            fprintf(stderr, "ERROR: LVZ stream is truncated or corrupt: %s (%zu WRLD files written before it broke off)\n",
+                    lvz_path, xc.written);
+            fprintf(log, "[error] LVZ stream broke off after %llu decompressed bytes; %zu WRLD files are incomplete output\n",
+                    (unsigned long long)decomp_len, xc.written);
+            img_close(&xc.img); fclose(log);
+            header_list_free(&headers);
+            return 3;
+        }
+        if (decomp_len < 32) {
+            fprintf(log, "[error] decompressed stream too small\n");
+            img_close(&xc.img); fclose(log);
+            header_list_free(&headers);
+            return 3;
+        }
+        if (!starts_dlrw) {
+            fprintf(log, "[warn] decompressed data does not start with DLRW\n");
+        }
+        if (header_list_total(&headers) == 0) {
+            fprintf(stderr, "No slave WRLD headers found.\n");
+            fprintf(log, "[error] no slave headers\n");
+            img_close(&xc.img); fclose(log);
+            header_list_free(&headers);
+            return 4;
+        }
+        if (have_key && src == 0) save_hidx(hidx_path, &key, fmt, decomp_len, &headers, log);
+    } else {
+        /* map the LVZ; inflate reads from the mapping and a stored LVZ is
+           scanned in place */
+        Blob lvz;
+        map_lvz(lvz_path, &lvz);
+        const uint8_t* lvz_raw = lvz.data;
+        size_t lvz_len = lvz.len;
+
+        /* decompress if possible, or take the inflated bytes from the cache */
+        SegBuf decomp;
+        LvzInfo li;
+        char cache_path[1200]; cache_path[0] = 0;
+        if (cache_dir) {
+            make_dir_if_needed(cache_dir);
+            cache_entry_path(cache_dir, lvz_raw, lvz_len, cache_path, sizeof(cache_path));
+        }
+        Blob cached;
+        if (cache_path[0] && cache_get(cache_path, &cached) == 0) {
+            segbuf_adopt(&decomp, &cached);
+            li.fmt = sniff_lvz_format(lvz_raw, lvz_len);
+            fprintf(log, "[cache] hit %s\n", cache_path);
+            fprintf(log, "[io] LVZ format: %s; inflate: cached\n", lvz_format_name(li.fmt));
+        } else {
+            maybe_decompress_lvz(&lvz, backend, size_prepass, threads, &decomp, &li);
+            size_t n = decomp.len;
+            fprintf(log, "[io] LVZ format: %s; inflate: %s", lvz_format_name(li.fmt), backend->name);
+            if (li.note[0]) fprintf(log, " [%s]", li.note);
+            fprintf(log, "; output sized from %s", li.size_src);
+            if (li.size_hint && li.size_hint != n)
+                fprintf(log, " (hint %zu was wrong)", li.size_hint);
+            if (decomp.nseg > 1) fprintf(log, "; %zu segments", decomp.nseg);
+            fprintf(log, "\n");
+            if (cache_path[0] && li.fmt != LVZ_STORED) {
+                if (cache_put(cache_dir, cache_path, &decomp) != 0) {
+                    fprintf(log, "[warn] cannot write cache entry %s (%s)\n", cache_path, strerror(errno));
+                } else {
+                    size_t gone = cache_evict(cache_dir, cache_max, cache_path);
+                    fprintf(log, "[cache] stored %s", cache_path);
+                    if (gone) fprintf(log, "; evicted %zu old entries", gone);
+                    fprintf(log, "\n");
+                }
+            }
+        }
+        blob_release(&lvz);
+        size_t decomp_len = decomp.len;
+        fprintf(log, "[io] LVZ bytes: %zu; decompressed: %zu\n", lvz_len, decomp_len);
+        if (decomp_len < 32) {
+            fprintf(log, "[error] decompressed stream too small\n");
+            fclose(log);
+            segbuf_free(&decomp);
+            return 3;
+        }
+        uint8_t dd[4];
+        segbuf_read(&decomp, 0, dd, 4);
+        if (!(dd[0]=='D'&&dd[1]=='L'&&dd[2]=='R'&&dd[3]=='W')) {
+            fprintf(log, "[warn] decompressed data does not start with DLRW, scanning anyway\n");
+        }
+
+        /* scan headers */
+        scan_slave_headers(&decomp, threads, &headers, log);
+        if (headers.count == 0) {
+            fprintf(stderr, "No slave WRLD headers found.\n");
+            fprintf(log, "[error] no slave headers\n");
+            fclose(log);
+            segbuf_free(&decomp);
+            return 4;
+        }
+        if (have_key) save_hidx(hidx_path, &key, li.fmt, decomp_len, &headers, log);
+        huge_report(log, "after inflate");
+        /* the headers carry their own bytes; the LVZ data is not needed for extraction */
+        segbuf_free(&decomp);
+
+        /* open IMG for streaming, get size */
+        if (img_open(&xc.img, img_path, img_io) != 0) {
+            fprintf(log, "[error] cannot open IMG\n");
+            fclose(log);
+            header_list_free(&headers);
+            return 5;
+        }
+        fprintf(log, "[io] IMG bytes: %llu; io: %s\n\n", (unsigned long long)xc.img.size,
+                img_io_name(xc.img.mode));
+
+        /* write each WRLD */
+        extract_all(&xc, headers.count, list_header_at, &headers, jobs);
+    }
+
+    if (xc.img.mode == IMG_IO_KERNEL || xc.img.mode == IMG_IO_URING) {
+        fprintf(log, "\n[io] body bytes: io_uring %llu, reflink %llu, copy_file_range %llu, sendfile %llu, user-space %llu\n",
+                (unsigned long long)xc.img.via_uring,
+                (unsigned long long)xc.img.cloned_bytes, (unsigned long long)xc.img.via_cfr,
+                (unsigned long long)xc.img.via_sendfile, (unsigned long long)xc.img.via_copy);
+        fprintf(log, "[io] reflink: %llu bodies cloned, %llu not block-aligned%s\n",
+                (unsigned long long)xc.img.cloned, (unsigned long long)xc.img.clone_unaligned,
+                xc.img.cloned == 0 && xc.img.no_clone ? " (not supported for this output)" : "");
+    }
+    if (xc.img.mode == IMG_IO_DIRECT) {
+        fprintf(log, "\n[io] O_DIRECT: %llu body bytes; WRLD output %s\n",
+                (unsigned long long)xc.img.via_direct,
+                xc.img.no_direct_out ? "through the page cache (O_DIRECT refused)" : "unbuffered");
+    }
+    if (readahead || drop_cache) {
+        fprintf(log, "[io] page cache: WILLNEED %llu IMG bytes; DONTNEED %llu IMG bytes and %llu WRLDs\n",
+                (unsigned long long)xc.img.willneed, (unsigned long long)xc.img.dontneed,
+                (unsigned long long)xc.img.dropped_out);
+    }
+    if (xc.img.mode != IMG_IO_MMAP) {
+        fprintf(log, "[io] copy buffers: %zu of %zu KiB; %llu chunks read ahead\n", buf_pool.created,
+                buf_pool.size >> 10, (unsigned long long)xc.img.read_ahead);
+        if (buf_pool.created) huge_report(log, "after extraction");
+    }
+#ifndef _WIN32
+    if (mem_budget) {
+        struct rusage ru;
+        if (getrusage(RUSAGE_SELF, &ru) == 0)
+            fprintf(log, "[mem] peak RSS %ld MiB of %llu MiB budget\n", ru.ru_maxrss >> 10,
+                    (unsigned long long)(mem_budget >> 20));
+    }
+#endif
+    if (arena) {
+        u64 saved = arena->allocs + arena->grows;
+        saved = saved > arena->blocks ? saved - arena->blocks : 0;
+        fprintf(log, "[alloc] arena: %llu allocations and %llu grows (%llu in place) from %llu new blocks; "
+                "%llu malloc calls saved; peak %zu KiB\n",
+                (unsigned long long)arena->allocs, (unsigned long long)arena->grows,
+                (unsigned long long)arena->in_place, (unsigned long long)arena->blocks,
+                (unsigned long long)saved, (arena->peak + 1023) >> 10);
+    }
+    fprintf(log, "\n[done] wrote %zu WRLD files to %s\n", xc.written, out_dir);
+    img_close(&xc.img);
+    sb_free(&xc.sb);
     fclose(log);
-    free(headers.items);
-    free(decomp);
+    header_list_free(&headers);
 
-    fprintf(stderr, "unIMG 2: extracted %zu WRLD files to %s\n", written, out_dir);
+    fprintf(stderr, "unIMG 2: extracted %zu WRLD files to %s\n", xc.written, out_dir);
     fprintf(stderr, "Log: %s\n", log_path);
     return 0;
 }
+
+static void banner(void) {
+    fprintf(stderr, "=== unIMG 2 Stories IMG Extractor ===\n");
+    fprintf(stderr, "Usage: unimg [options] <path-to>.lvz [more.lvz ...]\n");
+    fprintf(stderr, "  (several LVZs are extracted in turn, each to out_wrld/<stem>)\n");
+    fprintf(stderr, "  -t, --threads N   scan and parallel-inflate threads (default: one per CPU)\n");
+    fprintf(stderr, "  -j, --jobs N      write WRLD files with N workers (default: 1; not with --stream)\n");
+    fprintf(stderr, "  --stream          inflate and scan in chunks, extracting as headers are found\n");
+    fprintf(stderr, "  --size-prepass    measure zlib/raw output first so it is allocated once\n");
+    fprintf(stderr, "  --inflate NAME    inflate backend: zlib, builtin, parallel");
+#ifdef UNIMG_HAVE_LIBDEFLATE
+    fprintf(stderr, ", libdeflate");
+#endif
+    fprintf(stderr, " (default: %s)\n", UNIMG_DEFAULT_INFLATE);
+    fprintf(stderr, "  --io MODE         how WRLD bodies are copied from the IMG: kernel, uring, direct,\n");
+    fprintf(stderr, "                    mmap, stdio (default: %s)\n", img_io_name(IMG_IO_DEFAULT));
+    fprintf(stderr, "  --qd N            io_uring queue depth, in %u KiB pieces (default: %u)\n",
+            URING_CHUNK_KIB, URING_QD_DEFAULT);
+    fprintf(stderr, "  --chunk-size KIB  user-space copy chunk, a multiple of 4 (default: %u)\n", IMG_COPY_CHUNK >> 10);
+    fprintf(stderr, "  --readahead K     ask the kernel to prefetch the next K bodies (default: 0)\n");
+    fprintf(stderr, "  --drop-cache      drop copied IMG ranges and written WRLDs from the page cache\n");
+    fprintf(stderr, "  --no-plan         copy bodies in header order instead of IMG order\n");
+    fprintf(stderr, "  --mem-budget MIB  keep memory use under MIB (at least %u): stream the LVZ, bound\n", MEM_BUDGET_MIN);
+    fprintf(stderr, "                    buffers and workers, spill headers to a temporary file\n");
+    fprintf(stderr, "  --coalesce-gap KIB\n");
+    fprintf(stderr, "                    read bodies at most KIB apart in one pass (default: off)\n");
+    fprintf(stderr, "  --no-index        do not read or write the header index (<stem>.hidx)\n");
+    fprintf(stderr, "  --rebuild-index   ignore an existing header index and write a new one\n");
+    fprintf(stderr, "  --cache-dir DIR   reuse inflated LVZ data from DIR, adding to it on a miss\n");
+    fprintf(stderr, "  --cache-max MIB   evict least recently used cache entries above this (default: %llu)\n",
+            CACHE_DEFAULT_MAX >> 20);
+    fprintf(stderr, "  --zidx            save a random-access index (<stem>.zidx) while streaming\n");
+    fprintf(stderr, "  --zran-span MIB   output between index access points (default: %u)\n", ZIDX_DEFAULT_SPAN >> 20);
+    fprintf(stderr, "  --huge MODE       2 MiB pages for large buffers: thp, hugetlb (reserved pages,\n");
+    fprintf(stderr, "                    falling back to thp), off (default: thp; Linux only)\n");
+    fprintf(stderr, "  --alloc NAME      per-file table allocator: arena, system (default: arena)\n");
+    fprintf(stderr, "  --at OFF[,OFF..]  extract only the headers at these LVZ offsets, via the index\n");
+    fprintf(stderr, "  --bench-scan      benchmark the DLRW scan kernels and exit\n");
+    fprintf(stderr, "  --bench-inflate   benchmark the inflate backends and exit\n");
+    fprintf(stderr, "  --bench-extract   benchmark the extraction paths (honours -j and --qd) and exit\n\n");
+}
+
+int main(int argc, char** argv) {
+    const char** lvz_paths = NULL; size_t nlvz = 0;
+    int do_bench_scan = 0;
+    int do_bench_inflate = 0;
+    int do_bench_extract = 0;
+    int use_arena = 1;
+    HugeMode huge_mode = HUGE_THP;
+    Options o; memset(&o, 0, sizeof(o));
+    o.jobs = 1;
+    o.plan = 1;
+    o.coalesce_gap = -1;
+    o.chunk_size = IMG_COPY_CHUNK;
+    o.use_index = 1;
+    o.img_io = IMG_IO_DEFAULT;
+    o.cache_max = CACHE_DEFAULT_MAX;
+    o.zran_span = ZIDX_DEFAULT_SPAN;
+    u64* at = NULL; size_t at_count = 0;
+    o.backend = find_inflate_backend(UNIMG_DEFAULT_INFLATE);
+    if (!o.backend) o.backend = &inflate_backends[0];
+    for (int a = 1; a < argc; ++a) {
+        if (strcmp(argv[a], "--bench-scan") == 0) do_bench_scan = 1;
+        else if (strcmp(argv[a], "--bench-inflate") == 0) do_bench_inflate = 1;
+        else if (strcmp(argv[a], "--bench-extract") == 0) do_bench_extract = 1;
+        else if (strcmp(argv[a], "--inflate") == 0 && a + 1 < argc) {
+            o.backend = find_inflate_backend(argv[++a]);
+            if (!o.backend) { banner(); return 1; }
+        }
+        else if (strcmp(argv[a], "--alloc") == 0 && a + 1 < argc) {
+            ++a;
+            if (strcmp(argv[a], "arena") == 0) use_arena = 1;
+            else if (strcmp(argv[a], "system") == 0) use_arena = 0;
+            else { banner(); return 1; }
+        }
+        else if (strcmp(argv[a], "--huge") == 0 && a + 1 < argc) {
+            ++a;
+            if (strcmp(argv[a], "thp") == 0) huge_mode = HUGE_THP;
+            else if (strcmp(argv[a], "hugetlb") == 0) huge_mode = HUGE_TLB;
+            else if (strcmp(argv[a], "off") == 0) huge_mode = HUGE_OFF;
+            else { banner(); return 1; }
+        }
+        else if (strcmp(argv[a], "--stream") == 0) o.stream = 1;
+        else if (strcmp(argv[a], "--size-prepass") == 0) o.size_prepass = 1;
+        else if (strcmp(argv[a], "--zidx") == 0) o.save_zidx = 1;
+        else if (strcmp(argv[a], "--no-index") == 0) o.use_index = 0;
+        else if (strcmp(argv[a], "--io") == 0 && a + 1 < argc) {
+            ++a;
+            if (strcmp(argv[a], "mmap") == 0) o.img_io = IMG_IO_MMAP;
+            else if (strcmp(argv[a], "stdio") == 0) o.img_io = IMG_IO_STDIO;
+            else if (strcmp(argv[a], "kernel") == 0) o.img_io = IMG_IO_KERNEL;
+            else if (strcmp(argv[a], "uring") == 0) o.img_io = IMG_IO_URING;
+            else if (strcmp(argv[a], "direct") == 0) o.img_io = IMG_IO_DIRECT;
+            else { banner(); return 1; }
+        }
+        else if (strcmp(argv[a], "--cache-dir") == 0 && a + 1 < argc) o.cache_dir = argv[++a];
+        else if (strcmp(argv[a], "--cache-max") == 0 && a + 1 < argc)
+            o.cache_max = strtoull(argv[++a], NULL, 10) << 20;
+        else if (strcmp(argv[a], "--rebuild-index") == 0) o.rebuild_index = 1;
+        else if (strcmp(argv[a], "--zran-span") == 0 && a + 1 < argc) {
+            o.zran_span = strtoull(argv[++a], NULL, 10) << 20;
+            if (!o.zran_span) { banner(); return 1; }
+        }
+        else if (strcmp(argv[a], "--at") == 0 && a + 1 < argc) {
+            for (char* t = argv[++a]; *t; ) {
+                char* end;
+                u64 v = strtoull(t, &end, 0);
+                if (end == t || (*end && *end != ',')) { banner(); return 1; }
+                at = (u64*)xrealloc(at, (at_count + 1) * sizeof(u64));
+                at[at_count++] = v;
+                t = *end ? end + 1 : end;
+            }
+        }
+        else if ((strcmp(argv[a], "-t") == 0 || strcmp(argv[a], "--threads") == 0) && a + 1 < argc)
+            o.threads = atoi(argv[++a]);
+        else if (strcmp(argv[a], "--qd") == 0 && a + 1 < argc) o.qd = (unsigned)atoi(argv[++a]);
+        else if (strcmp(argv[a], "--no-plan") == 0) o.plan = 0;
+        else if (strcmp(argv[a], "--readahead") == 0 && a + 1 < argc) o.readahead = (unsigned)atoi(argv[++a]);
+        else if (strcmp(argv[a], "--drop-cache") == 0) o.drop_cache = 1;
+        else if (strcmp(argv[a], "--mem-budget") == 0 && a + 1 < argc) {
+            o.mem_budget = strtoull(argv[++a], NULL, 10);
+            if (o.mem_budget < MEM_BUDGET_MIN) { banner(); return 1; }
+            o.mem_budget <<= 20;
+        }
+        else if (strcmp(argv[a], "--chunk-size") == 0 && a + 1 < argc) {
+            long long kib = atoll(argv[++a]);
+            if (kib <= 0 || kib > (1 << 20) || (kib << 10) % BUF_ALIGN) { banner(); return 1; }
+            o.chunk_size = (size_t)kib << 10;
+        }
+        else if (strcmp(argv[a], "--coalesce-gap") == 0 && a + 1 < argc) {
+            o.coalesce_gap = atoll(argv[++a]);
+            if (o.coalesce_gap < 0) { banner(); return 1; }
+            o.coalesce_gap <<= 10;
+        }
+        else if ((strcmp(argv[a], "-j") == 0 || strcmp(argv[a], "--jobs") == 0) && a + 1 < argc)
+            o.jobs = atoi(argv[++a]);
+        else if (argv[a][0] == '-') { banner(); return 1; }
+        else {
+            lvz_paths = (const char**)xrealloc((void*)lvz_paths, (nlvz + 1) * sizeof(*lvz_paths));
+            lvz_paths[nlvz++] = argv[a];
+        }
+    }
+    int bench = do_bench_scan || do_bench_inflate || do_bench_extract;
+    if (!nlvz || (bench && nlvz > 1)) {
+        banner();
+        return 1;
+    }
+    o.at = at; o.at_count = at_count;
+    o.batch = nlvz > 1;
+    o.chunk_req = o.chunk_size;
+    o.qd_req = o.qd ? o.qd : URING_QD_DEFAULT;
+    if (o.mem_budget) {
+        size_t cap = (size_t)(o.mem_budget / 16) & ~(size_t)(BUF_ALIGN - 1);
+        if (o.chunk_size > cap) o.chunk_size = cap;
+        unsigned qd_max = (unsigned)(o.mem_budget / 8 / URING_CHUNK);
+        if (o.qd_req > qd_max) o.qd = qd_max;
+        header_list_max = (size_t)(o.mem_budget / 8 / sizeof(WrldHeader));
+    }
+    huge_init(huge_mode);
+    buf_pool_init(o.chunk_size);
+    if (do_bench_scan) return bench_scan(lvz_paths[0], o.threads);
+    if (do_bench_inflate) return bench_inflate(lvz_paths[0], o.threads);
+    if (do_bench_extract) return bench_extract(lvz_paths[0], o.jobs, o.qd, o.plan, o.coalesce_gap);
+
+    /* one arena for the whole batch; each file starts from a reset one */
+    Arena arena;
+    if (use_arena) arena_init(&arena);
+    int rc = 0;
+    for (size_t i = 0; i < nlvz; ++i) {
+        int r = extract_lvz(lvz_paths[i], &o, use_arena ? &arena : NULL);
+        if (r && !rc) rc = r;
+        if (use_arena) arena_reset(&arena);
+    }
+    if (use_arena) arena_free(&arena);
+    free(at);
+    free((void*)lvz_paths);
+    return rc;
+}